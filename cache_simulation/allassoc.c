@@ -0,0 +1,133 @@
+/*
+ * allassoc.c - All-associativity LRU simulation in one pass
+ *
+ * For each s, every set has a stack of the blocks it has seen, most
+ * recently used first. Only the top max_E entries matter: a block found
+ * deeper misses in every cache simulated, so the stacks are cut off
+ * there. An access at depth d hits in the caches of more than d ways;
+ * counting accesses by depth gives every E's hits with one sum.
+ *
+ * A set's stack only drops a block once it is max_E deep, so its depth
+ * is the number of distinct blocks the set has seen, capped at max_E.
+ * An E-way set fills min(E, depth) lines without evicting, and every
+ * other miss evicts.
+ */
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include "allassoc.h"
+
+typedef struct allassoc_level {
+    mem_addr_t set_mask;
+    mem_addr_t* stacks;             /* set * max_E + depth */
+    unsigned int* depth;            /* per set */
+    unsigned long long* at_depth;   /* accesses by depth; max_E: not found */
+} allassoc_level_t;
+
+struct allassoc {
+    int smin, smax, max_E, b;
+    unsigned long long accesses;
+    allassoc_level_t* levels;       /* one per s */
+};
+
+allassoc_t* allassocCreate(int smin, int smax, int max_E, int b)
+{
+    allassoc_t* aa;
+
+    if (smin < 0 || smax < smin || smax >= 32 || max_E <= 0) {
+        errno = EINVAL;
+        return NULL;
+    }
+    aa = (allassoc_t*)calloc(1, sizeof(allassoc_t));
+    if (aa == NULL)
+        return NULL;
+    aa->smin = smin;
+    aa->smax = smax;
+    aa->max_E = max_E;
+    aa->b = b;
+    aa->levels = (allassoc_level_t*)calloc(smax - smin + 1, sizeof(allassoc_level_t));
+    if (aa->levels == NULL)
+        goto nomem;
+
+    for (int s = smin; s <= smax; s++) {
+        allassoc_level_t* lv = &aa->levels[s - smin];
+        size_t sets = (size_t)1 << s;
+
+        lv->set_mask = sets - 1;
+        if (sets > ((size_t)-1) / sizeof(mem_addr_t) / max_E)
+            goto nomem;
+        lv->stacks = (mem_addr_t*)malloc(sets * max_E * sizeof(mem_addr_t));
+        lv->depth = (unsigned int*)calloc(sets, sizeof(unsigned int));
+        lv->at_depth = (unsigned long long*)calloc(max_E + 1, sizeof(unsigned long long));
+        if (lv->stacks == NULL || lv->depth == NULL || lv->at_depth == NULL)
+            goto nomem;
+    }
+    return aa;
+
+nomem:
+    allassocFree(aa);
+    errno = ENOMEM;
+    return NULL;
+}
+
+void allassocAccess(allassoc_t* aa, mem_addr_t addr)
+{
+    mem_addr_t block = addr >> aa->b;
+    unsigned int max_E = aa->max_E;
+
+    aa->accesses++;
+    for (int s = aa->smin; s <= aa->smax; s++) {
+        allassoc_level_t* lv = &aa->levels[s - aa->smin];
+        size_t set = block & lv->set_mask;
+        mem_addr_t* stack = lv->stacks + set * max_E;
+        unsigned int depth = lv->depth[set];
+        unsigned int d = 0;
+
+        while (d < depth && stack[d] != block)
+            d++;
+        lv->at_depth[d < depth ? d : max_E]++;
+        if (d == depth) {
+            /* Not on the stack: push it, dropping the bottom if full */
+            if (depth < max_E)
+                lv->depth[set] = depth + 1;
+            else
+                d = max_E - 1;
+        }
+        memmove(stack + 1, stack, d * sizeof(mem_addr_t));
+        stack[0] = block;
+    }
+}
+
+void allassocResult(const allassoc_t* aa, int s, int E,
+                    unsigned long long* hits, unsigned long long* misses,
+                    unsigned long long* evictions)
+{
+    const allassoc_level_t* lv = &aa->levels[s - aa->smin];
+    unsigned long long fills = 0;
+
+    *hits = 0;
+    for (int d = 0; d < E; d++)
+        *hits += lv->at_depth[d];
+    *misses = aa->accesses - *hits;
+    for (size_t set = 0; set <= lv->set_mask; set++)
+        fills += lv->depth[set] < (unsigned int)E ? lv->depth[set] : (unsigned int)E;
+    *evictions = *misses - fills;
+}
+
+void allassocFree(allassoc_t* aa)
+{
+    if (aa == NULL)
+        return;
+    if (aa->levels != NULL) {
+        for (int s = aa->smin; s <= aa->smax; s++) {
+            free(aa->levels[s - aa->smin].stacks);
+            free(aa->levels[s - aa->smin].depth);
+            free(aa->levels[s - aa->smin].at_depth);
+        }
+    }
+    free(aa->levels);
+    free(aa);
+}
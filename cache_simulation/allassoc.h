@@ -0,0 +1,43 @@
+/*
+ * allassoc.h - All-associativity LRU simulation in one pass
+ *
+ * LRU has the inclusion property: within a set, a cache of E ways holds
+ * the E most recently used blocks of that set. So an access hits in
+ * every cache of more ways than the number of other blocks of its set
+ * used since its own block's last use. Keeping a recency stack per set
+ * gives that distance, and with it the hits, misses and evictions of
+ * every associativity from 1 to a maximum in a single pass (Hill and
+ * Smith's all-associativity simulation). Stacks for several set counts
+ * can be kept side by side, covering a range of s at once.
+ */
+
+#ifndef CACHELAB_ALLASSOC_H
+#define CACHELAB_ALLASSOC_H
+
+#include "trace.h"
+
+typedef struct allassoc allassoc_t;
+
+/*
+ * allassocCreate - Simulate caches of 2^b-byte blocks with 2^s sets for
+ *                  every s from smin to smax and every associativity from
+ *                  1 to max_E at once. Returns NULL and sets errno on
+ *                  failure.
+ */
+allassoc_t* allassocCreate(int smin, int smax, int max_E, int b);
+
+/* allassocAccess - Access the block holding addr in all the caches */
+void allassocAccess(allassoc_t* aa, mem_addr_t addr);
+
+/*
+ * allassocResult - Get the counts of the cache with 2^s sets of E lines,
+ *                  smin <= s <= smax and 1 <= E <= max_E
+ */
+void allassocResult(const allassoc_t* aa, int s, int E,
+                    unsigned long long* hits, unsigned long long* misses,
+                    unsigned long long* evictions);
+
+/* allassocFree - Free everything */
+void allassocFree(allassoc_t* aa);
+
+#endif /* CACHELAB_ALLASSOC_H */
@@ -0,0 +1,759 @@
+/*
+ * cache.c - Simulated LRU caches
+ *
+ * A cache replays batches of records through a kernel picked for its
+ * shape when it is created: a hash table for very high associativity,
+ * SIMD scans where the CPU has them, kernels specialized for common
+ * associativities, and a generic one for everything else. All of them
+ * count exactly like the reference simulator.
+ */
+#define _DEFAULT_SOURCE /* MAP_ANONYMOUS, MAP_HUGETLB, MADV_HUGEPAGE */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/mman.h>
+
+#include "cache.h"
+#include "hashlru.h"
+#include "tagscan.h"
+
+/* Type: Replay kernel
+ * Replays a batch of records against the cache
+ */
+typedef void (*replay_kernel_t)(cache_t* cache, const trace_rec_t* recs, size_t n);
+
+/* Type: Cache
+ * All sets live in one contiguous, cache-line-aligned allocation,
+ * stored as separate arrays so a lookup only touches the tags:
+ *   tags[set * stride + way]  tag of each line, TAG_INVALID if empty
+ *   lru[set * stride + way]   time of the line's last access
+ *   fill[set]                 number of valid lines in the set
+ * Lines are never invalidated, so a set's valid lines always form a
+ * prefix and fill is all the valid bits it needs. stride pads E so a
+ * set's tags never straddle more host cache lines than necessary;
+ * padding ways stay empty and have the time stamp STAMP_PAD.
+ * While narrow is set, the tags array holds unsigned int tags instead,
+ * with TAG_INVALID32 for an empty way, so the SIMD kernels compare twice
+ * as many ways per instruction. The cache starts out narrow and is
+ * widened as soon as a tag does not fit or a kernel needs 64-bit tags.
+ * tags is untyped so that each kernel takes the one view of it that
+ * matches the width in use; the array is only ever accessed through
+ * that view, or bytewise when it is cleared or widened.
+ * Sets of HASHED_MIN_WAYS or more lines are too large to scan; such a
+ * cache lives in hashed instead and none of the arrays are allocated.
+ * Once the arrays outgrow the host's caches, the kernels prefetch the
+ * sets of the records a few ahead. With CACHE_REORDER, records are held
+ * back in pending until a block is full, then replayed in order of
+ * their set's bucket, from sorted. The kernels that print every access
+ * in verbose mode are also the ones that fill in hit_bits.
+ */
+struct cache {
+    int s, E, b;
+    int verbose;
+    replay_kernel_t replay;     /* picked by selectKernel() */
+    unsigned char* hit_bits;    /* outcomes wanted by cacheReplayOutcomes() */
+    size_t outcome;             /* record whose outcome comes next */
+
+    void* tags;                 /* mem_addr_t, or unsigned int while narrow */
+    unsigned long long* lru;
+    unsigned int* fill;
+    size_t stride;
+    unsigned long long clock;   /* accesses so far, the LRU time stamp */
+    int narrow;         /* tags are 32 bits wide */
+    hashlru_t* hashed;  /* the cache, if it has HASHED_MIN_WAYS ways or more */
+    void* mem;          /* the allocation holding all of the above */
+    size_t mem_len;
+    int mapped;         /* mem came from mmap() rather than malloc() */
+    int prefetch;       /* the arrays take PREFETCH_MIN_BYTES or more */
+
+    trace_rec_t* pending;       /* REORDER_BLOCK records, NULL: no reordering */
+    size_t npending;
+    trace_rec_t* sorted;
+    unsigned int* buckets;      /* records of each bucket, then their offsets */
+    int bucket_shift;
+    mem_addr_t bucket_mask;
+
+    unsigned long long hits;
+    unsigned long long misses;
+    unsigned long long evictions;
+};
+
+/* Associativity from which a hash table beats scanning the set: up to
+ * 16 ways, the SIMD kernels scan a set faster than it can be hashed
+ */
+#define HASHED_MIN_WAYS 17
+
+#define HUGE_PAGE_SIZE (2UL << 20)
+
+/* Size of the arrays from which the kernels prefetch, about a host L2,
+ * and how many records ahead they do
+ */
+#define PREFETCH_MIN_BYTES (1UL << 20)
+#define PREFETCH_AHEAD 8
+
+/* Records per reordered block, and buckets it is sorted into: each
+ * bucket covers 1/REORDER_BUCKETS of the sets
+ */
+#define REORDER_BLOCK (1 << 16)
+#define REORDER_BUCKETS_LOG 12
+
+static replay_kernel_t selectKernel(cache_t* cache);
+
+/* alignUp - round n up to a multiple of align (a power of two) */
+static size_t alignUp(size_t n, size_t align)
+{
+    return (n + align - 1) & ~(align - 1);
+}
+
+/* allocCache - get len bytes of zeroed memory, aligned to a host cache
+ * line; with huge pages, try explicit ones, then transparent ones
+ */
+static void* allocCache(cache_t* cache, size_t len, int huge_pages)
+{
+    void* mem;
+
+    cache->mapped = 0;
+    if (huge_pages) {
+        cache->mem_len = alignUp(len, HUGE_PAGE_SIZE);
+        mem = mmap(NULL, cache->mem_len, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (mem == MAP_FAILED) {
+            mem = mmap(NULL, cache->mem_len, PROT_READ | PROT_WRITE,
+                       MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            if (mem != MAP_FAILED)
+                madvise(mem, cache->mem_len, MADV_HUGEPAGE);
+        }
+        if (mem != MAP_FAILED) {
+            cache->mapped = 1;
+            return mem;
+        }
+    }
+    cache->mem_len = len;
+    if (posix_memalign(&mem, HOST_CACHE_LINE, len) != 0)
+        return NULL;
+    memset(mem, 0, len);
+    return mem;
+}
+
+cache_t* cacheCreate(int s, int E, int b, int flags)
+{
+    cache_t* cache;
+    size_t S;
+
+    if (s < 0 || E <= 0 || b < 0 || s >= 64 || b >= 64 || s + b == 0 || s + b >= 64) {
+        errno = EINVAL;
+        return NULL;
+    }
+    cache = (cache_t*)calloc(1, sizeof(cache_t));
+    if (cache == NULL)
+        return NULL;
+    cache->s = s;
+    cache->E = E;
+    cache->b = b;
+    cache->verbose = (flags & CACHE_VERBOSE) != 0;
+    S = (size_t)1 << s;
+
+    if (E >= HASHED_MIN_WAYS) {
+        cache->hashed = hashlruCreate(s, E, b);
+        if (cache->hashed == NULL) {
+            free(cache);
+            return NULL;
+        }
+        cache->replay = selectKernel(cache);
+        return cache;
+    }
+
+    /* Pad small sets to a power of two ways, so they pack host cache
+     * lines exactly, and large ones to whole host cache lines
+     */
+    size_t per_line = HOST_CACHE_LINE / sizeof(mem_addr_t);
+    if ((size_t)E < per_line) {
+        cache->stride = 1;
+        while (cache->stride < (size_t)E)
+            cache->stride <<= 1;
+    } else {
+        cache->stride = alignUp(E, per_line);
+    }
+
+    size_t lines = S * cache->stride;
+    size_t tags_len = alignUp(lines * sizeof(mem_addr_t), HOST_CACHE_LINE);
+    size_t lru_len = alignUp(lines * sizeof(unsigned long long), HOST_CACHE_LINE);
+    size_t fill_len = alignUp(S * sizeof(unsigned int), HOST_CACHE_LINE);
+
+    if (lines / cache->stride != S || lines > ((size_t)-1) / 32) {
+        free(cache);
+        errno = ENOMEM;
+        return NULL;
+    }
+    cache->mem = allocCache(cache, tags_len + lru_len + fill_len,
+                            (flags & CACHE_HUGE_PAGES) != 0);
+    if (cache->mem == NULL) {
+        free(cache);
+        errno = ENOMEM;
+        return NULL;
+    }
+    cache->tags = cache->mem;
+    cache->lru = (unsigned long long*)((char*)cache->mem + tags_len);
+    cache->fill = (unsigned int*)((char*)cache->mem + tags_len + lru_len);
+    /* All ones is an empty way in 32-bit and 64-bit tags alike; set
+     * bytewise, so either view may read it
+     */
+    memset(cache->tags, 0xff, lines * sizeof(mem_addr_t));
+    cache->narrow = 1;
+    for (size_t set = 0; set < S; set++) {
+        for (size_t i = E; i < cache->stride; i++)
+            cache->lru[set * cache->stride + i] = STAMP_PAD;
+    }
+    cache->prefetch = tags_len + lru_len >= PREFETCH_MIN_BYTES;
+    cache->replay = selectKernel(cache);
+
+    /* Reordering changes the order of the verbose output */
+    if ((flags & CACHE_REORDER) && !cache->verbose && s > 0) {
+        int bits = s < REORDER_BUCKETS_LOG ? s : REORDER_BUCKETS_LOG;
+
+        cache->bucket_shift = b + s - bits;
+        cache->bucket_mask = ((mem_addr_t)1 << bits) - 1;
+        cache->pending = (trace_rec_t*)malloc(REORDER_BLOCK * sizeof(trace_rec_t));
+        cache->sorted = (trace_rec_t*)malloc(REORDER_BLOCK * sizeof(trace_rec_t));
+        cache->buckets = (unsigned int*)malloc(sizeof(unsigned int) << bits);
+        if (cache->pending == NULL || cache->sorted == NULL || cache->buckets == NULL) {
+            cacheFree(cache);
+            errno = ENOMEM;
+            return NULL;
+        }
+    }
+    return cache;
+}
+
+/* widenTags - switch the cache from 32-bit to 64-bit tags in place.
+ * Walking down from the last way, a 64-bit tag never overwrites a 32-bit
+ * one that has yet to be read.
+ */
+static void widenTags(cache_t* cache)
+{
+    char* mem = (char*)cache->tags;
+
+    cache->narrow = 0;
+    if (cache->clock == 0)
+        return;     /* still all empty */
+    for (size_t i = ((size_t)1 << cache->s) * cache->stride; i-- > 0; ) {
+        unsigned int narrow_tag;
+        mem_addr_t tag;
+
+        memcpy(&narrow_tag, mem + i * sizeof(narrow_tag), sizeof(narrow_tag));
+        tag = narrow_tag == TAG_INVALID32 ? TAG_INVALID : narrow_tag;
+        memcpy(mem + i * sizeof(tag), &tag, sizeof(tag));
+    }
+}
+
+void cacheFree(cache_t* cache)
+{
+    if (cache == NULL)
+        return;
+    if (cache->hashed)
+        hashlruFree(cache->hashed);
+    else if (cache->mapped)
+        munmap(cache->mem, cache->mem_len);
+    else
+        free(cache->mem);
+    free(cache->pending);
+    free(cache->sorted);
+    free(cache->buckets);
+    free(cache);
+}
+
+/* replayPending - replay the pending records bucket by bucket, sorted
+ * with one stable counting sort pass on the high bits of the set index.
+ * Records of the same set keep their order, so the counts do not change,
+ * while each bucket works on a slice of the arrays small enough to stay
+ * in the host's caches.
+ */
+static void replayPending(cache_t* cache)
+{
+    const trace_rec_t* pending = cache->pending;
+    unsigned int* buckets = cache->buckets;
+    const int shift = cache->bucket_shift;
+    const mem_addr_t mask = cache->bucket_mask;
+    size_t n = cache->npending;
+    unsigned int offset = 0;
+
+    memset(buckets, 0, (mask + 1) * sizeof(unsigned int));
+    for (size_t i = 0; i < n; i++)
+        buckets[(pending[i].addr >> shift) & mask]++;
+    for (size_t i = 0; i <= mask; i++) {
+        unsigned int count = buckets[i];
+
+        buckets[i] = offset;
+        offset += count;
+    }
+    for (size_t i = 0; i < n; i++)
+        cache->sorted[buckets[(pending[i].addr >> shift) & mask]++] = pending[i];
+    cache->replay(cache, cache->sorted, n);
+    cache->npending = 0;
+}
+
+void cacheReplay(cache_t* cache, const trace_rec_t* recs, size_t n)
+{
+    if (cache->pending == NULL) {
+        cache->replay(cache, recs, n);
+        return;
+    }
+    while (n > 0) {
+        size_t room = REORDER_BLOCK - cache->npending;
+        size_t take = n < room ? n : room;
+
+        memcpy(cache->pending + cache->npending, recs, take * sizeof(trace_rec_t));
+        cache->npending += take;
+        recs += take;
+        n -= take;
+        if (cache->npending == REORDER_BLOCK)
+            replayPending(cache);
+    }
+}
+
+/* cacheReplayOutcomes - replay through the kernel that reports each
+ * outcome, in trace order: held back records go first, and these are
+ * not held back
+ */
+void cacheReplayOutcomes(cache_t* cache, const trace_rec_t* recs, size_t n,
+                         unsigned char* hit_bits)
+{
+    if (cache->npending > 0)
+        replayPending(cache);
+    cache->hit_bits = hit_bits;
+    cache->outcome = 0;
+    cache->replay = selectKernel(cache);
+    cache->replay(cache, recs, n);
+    cache->hit_bits = NULL;
+    cache->replay = selectKernel(cache);
+}
+
+void cacheStats(cache_t* cache, cache_stats_t* stats)
+{
+    if (cache->npending > 0)
+        replayPending(cache);
+    stats->hits = cache->hits;
+    stats->misses = cache->misses;
+    stats->evictions = cache->evictions;
+}
+
+/* updateLRU - Mark a line as the most recently used in its set.
+ * Every access gets a new time stamp from the cache's clock, so the
+ * least recently used line of a set is simply the one with the oldest
+ * stamp; nothing else in the set has to change.
+ */
+static void updateLRU(cache_t* cache, size_t setIndex, unsigned int lineIndex)
+{
+    cache->lru[setIndex * cache->stride + lineIndex] = ++cache->clock;
+}
+
+/* printAccess - Print the outcome of one access in verbose mode */
+static void printAccess(mem_addr_t addr, int hit, int evict)
+{
+    printf("Address: %llx - ", addr);
+    if (hit) {
+        printf("hit\n");
+    } else {
+        printf("miss");
+        if (evict)
+            printf(" eviction");
+        printf("\n");
+    }
+}
+
+/* reportAccess - Report the outcome of a record's (first) access: set
+ * its bit in hit_bits if they are wanted, else print it
+ */
+static void reportAccess(cache_t* cache, mem_addr_t addr, int hit, int evict)
+{
+    if (cache->hit_bits != NULL) {
+        size_t i = cache->outcome++;
+        unsigned char bit = (unsigned char)(1U << (i & 7));
+
+        cache->hit_bits[i >> 3] = hit ? cache->hit_bits[i >> 3] | bit
+                                      : cache->hit_bits[i >> 3] & ~bit;
+    } else {
+        printAccess(addr, hit, evict);
+    }
+}
+
+/* reportModify - Report the second access of an M, which always hits;
+ * hit_bits only have the first
+ */
+static void reportModify(cache_t* cache, mem_addr_t addr)
+{
+    if (cache->hit_bits == NULL)
+        printAccess(addr, 1, 0);
+}
+
+/* accessData - Access data at memory address addr.
+ *   If it is already in cache, count a hit
+ *   If it is not in cache, bring it in cache and count a miss.
+ *   Also count an eviction if a line is evicted.
+ *   Least-Recently-Used (LRU) cache replacement policy
+ *   Returns whether it hit; *evict tells whether it evicted.
+ */
+static int accessData(cache_t* cache, mem_addr_t addr, int* evict_out)
+{
+    mem_addr_t tag = addr >> (cache->s + cache->b);     // Extract the tag
+    size_t setIndex = (addr >> cache->b) & (((mem_addr_t)1 << cache->s) - 1);
+    mem_addr_t* tags = (mem_addr_t*)cache->tags + setIndex * cache->stride;
+    unsigned long long* lru = cache->lru + setIndex * cache->stride;
+    unsigned int fill = cache->fill[setIndex];
+
+    int hit = 0;
+    int evict = 0;
+
+    // Check for hits among the valid lines
+    for (unsigned int i = 0; i < fill; i++) {
+        if (tags[i] == tag) {
+            hit = 1;
+            cache->hits++;
+            updateLRU(cache, setIndex, i);
+            break;
+        }
+    }
+
+    if (!hit) {
+        cache->misses++;
+        if (fill < (unsigned int)cache->E) {
+            // Place the new line in the first empty cache slot
+            tags[fill] = tag;
+            cache->fill[setIndex] = fill + 1;
+            updateLRU(cache, setIndex, fill);
+        } else {
+            // Evict the least recently used line: the oldest time stamp
+            unsigned int lru_index = 0;
+            for (unsigned int i = 1; i < fill; i++) {
+                if (lru[i] < lru[lru_index])
+                    lru_index = i;
+            }
+            evict = 1;
+            cache->evictions++;
+            tags[lru_index] = tag;
+            updateLRU(cache, setIndex, lru_index);
+        }
+    }
+
+    *evict_out = evict;
+    return hit;
+}
+
+/* replayBatch - replays a batch of records, for any associativity
+ * short of a hashed cache
+ */
+static void replayBatch(cache_t* cache, const trace_rec_t* recs, size_t n)
+{
+    const int report = cache->verbose || cache->hit_bits != NULL;
+    int evict;
+
+    for (size_t i = 0; i < n; i++) {
+        int hit = accessData(cache, recs[i].addr, &evict);
+
+        if (report)
+            reportAccess(cache, recs[i].addr, hit, evict);
+        if (recs[i].op == 'M') {
+            accessData(cache, recs[i].addr, &evict);    // For 'M', access twice
+            if (report)
+                reportModify(cache, recs[i].addr);
+        }
+    }
+}
+
+/* replayWays - replays a batch against a cache of exactly ways lines per
+ * set (so the stride is ways too). It is only ever inlined into kernels
+ * that pass constant ways and report, which lets the compiler unroll
+ * the set scans, turn the victim search into a compare-and-select chain
+ * and drop the reporting of outcomes when it is off. Empty lines hold
+ * TAG_INVALID and time stamp 0, so the oldest stamp in a set is its
+ * first empty line if it has one and its least recently used line
+ * otherwise. The second access of an M always hits the line the first
+ * one left.
+ */
+static inline __attribute__((always_inline))
+void replayWays(cache_t* cache, const trace_rec_t* recs, size_t n,
+                const unsigned int ways, const int report)
+{
+    const int b = cache->b;
+    const int shift = cache->s + b;
+    const mem_addr_t set_mask = ((mem_addr_t)1 << cache->s) - 1;
+    /* selectKernel() widens the tags for the scalar kernels */
+    mem_addr_t* const all_tags = (mem_addr_t*)cache->tags;
+    unsigned long long* const all_lru = cache->lru;
+    /* A direct-mapped lookup is too short to hide a prefetch behind */
+    const int prefetch = ways > 1 && cache->prefetch;
+    unsigned long long clock = cache->clock;
+    unsigned long long hits = 0, misses = 0, evictions = 0;
+
+    for (size_t r = 0; r < n; r++) {
+        if (prefetch && r + PREFETCH_AHEAD < n) {
+            size_t ahead = (recs[r + PREFETCH_AHEAD].addr >> b) & set_mask;
+
+            __builtin_prefetch(all_tags + ahead * ways, 1);
+            __builtin_prefetch(all_lru + ahead * ways, 1);
+        }
+        mem_addr_t addr = recs[r].addr;
+        mem_addr_t tag = addr >> shift;
+        size_t set = (addr >> b) & set_mask;
+        mem_addr_t* tags = all_tags + set * ways;
+        unsigned long long* lru = all_lru + set * ways;
+        unsigned int way = ways;
+
+        for (unsigned int i = 0; i < ways; i++) {
+            if (tags[i] == tag) {
+                way = i;
+                break;
+            }
+        }
+        if (way < ways) {
+            hits++;
+            if (report)
+                reportAccess(cache, addr, 1, 0);
+        } else {
+            way = 0;
+            for (unsigned int i = 1; i < ways; i++)
+                way = lru[i] < lru[way] ? i : way;
+            int evict = tags[way] != TAG_INVALID;
+            misses++;
+            evictions += evict;
+            cache->fill[set] += !evict;
+            tags[way] = tag;
+            if (report)
+                reportAccess(cache, addr, 0, evict);
+        }
+        if (ways > 1)
+            lru[way] = ++clock;
+        if (recs[r].op == 'M') {
+            hits++;
+            if (ways > 1)
+                lru[way] = ++clock;
+            if (report)
+                reportModify(cache, addr);
+        }
+    }
+
+    cache->clock = clock;
+    cache->hits += hits;
+    cache->misses += misses;
+    cache->evictions += evictions;
+}
+
+#define REPLAY_KERNEL(ways, report)                                     \
+    static void replay##ways##_##report(cache_t* cache,                 \
+                                        const trace_rec_t* recs, size_t n) \
+    {                                                                   \
+        replayWays(cache, recs, n, ways, report);                       \
+    }
+
+REPLAY_KERNEL(1, 0) REPLAY_KERNEL(1, 1)
+REPLAY_KERNEL(2, 0) REPLAY_KERNEL(2, 1)
+REPLAY_KERNEL(4, 0) REPLAY_KERNEL(4, 1)
+REPLAY_KERNEL(8, 0) REPLAY_KERNEL(8, 1)
+REPLAY_KERNEL(16, 0) REPLAY_KERNEL(16, 1)
+
+/* replayHashed - replays a batch against a hashed cache */
+static void replayHashed(cache_t* cache, const trace_rec_t* recs, size_t n)
+{
+    const int report = cache->verbose || cache->hit_bits != NULL;
+
+    for (size_t i = 0; i < n; i++) {
+        int outcome = hashlruAccess(cache->hashed, recs[i].addr);
+
+        if (outcome == HASHLRU_HIT) {
+            cache->hits++;
+        } else {
+            cache->misses++;
+            cache->evictions += outcome == HASHLRU_EVICT;
+        }
+        if (report) {
+            reportAccess(cache, recs[i].addr, outcome == HASHLRU_HIT,
+                         outcome == HASHLRU_EVICT);
+        }
+        if (recs[i].op == 'M') {
+            cache->hits++;  // The block is the most recently used already
+            if (report)
+                reportModify(cache, recs[i].addr);
+        }
+    }
+}
+
+#ifdef TAGSCAN_SIMD
+/* Instruction sets of the SIMD kernels */
+#define ISA_SSE4 0
+#define ISA_AVX2 1
+
+/* widenAndReplay - replay the rest of a batch after a tag turned out not
+ * to fit in 32 bits
+ */
+static __attribute__((noinline))
+void widenAndReplay(cache_t* cache, const trace_rec_t* recs, size_t n)
+{
+    widenTags(cache);
+    cache->replay = selectKernel(cache);
+    cache->replay(cache, recs, n);
+}
+
+/* replaySimd - replays a batch against sets of ways lines (the stride),
+ * comparing the tag against all of them at once. A hit is the lowest bit
+ * of the match mask; on a miss the way with the oldest time stamp is
+ * the first empty way if there is one, and the victim otherwise. Small
+ * sets find it with a compare-and-select chain, which is shorter than
+ * the SIMD reduction. Only ever inlined into a kernel compiled for
+ * instruction set isa, with constant ways, isa and narrow.
+ */
+static inline void replaySimd(cache_t* cache, const trace_rec_t* recs, size_t n,
+                              const unsigned int ways, const int isa,
+                              const int narrow)
+{
+    const int b = cache->b;
+    const int shift = cache->s + b;
+    const mem_addr_t set_mask = ((mem_addr_t)1 << cache->s) - 1;
+    const int report = cache->verbose || cache->hit_bits != NULL;
+    /* Only the view of the width in use is ever accessed */
+    mem_addr_t* const all_tags = (mem_addr_t*)cache->tags;
+    unsigned int* const all_tags32 = (unsigned int*)cache->tags;
+    unsigned long long* const all_lru = cache->lru;
+    const int prefetch = cache->prefetch;
+    unsigned long long clock = cache->clock;
+    unsigned long long hits = 0, misses = 0, evictions = 0;
+    size_t r;
+
+    for (r = 0; r < n; r++) {
+        if (prefetch && r + PREFETCH_AHEAD < n) {
+            size_t ahead = (recs[r + PREFETCH_AHEAD].addr >> b) & set_mask;
+
+            if (narrow)
+                __builtin_prefetch(all_tags32 + ahead * ways, 1);
+            else
+                __builtin_prefetch(all_tags + ahead * ways, 1);
+            __builtin_prefetch(all_lru + ahead * ways, 1);
+        }
+        mem_addr_t addr = recs[r].addr;
+        mem_addr_t tag = addr >> shift;
+        size_t set = (addr >> b) & set_mask;
+        mem_addr_t* tags = all_tags + set * ways;
+        unsigned int* tags32 = all_tags32 + set * ways;
+        unsigned long long* lru = all_lru + set * ways;
+        unsigned int match, way;
+        int evict = 0;
+
+        if (narrow) {
+            if (tag >= TAG_INVALID32)
+                break;
+            match = isa == ISA_AVX2 ? tagMatch32Avx2(tags32, ways, tag)
+                                    : tagMatch32Sse4(tags32, ways, tag);
+        } else {
+            match = isa == ISA_AVX2 ? tagMatch64Avx2(tags, ways, tag)
+                                    : tagMatch64Sse4(tags, ways, tag);
+        }
+
+        if (match) {
+            way = __builtin_ctz(match);
+            hits++;
+        } else {
+            if (ways <= 8) {
+                way = 0;
+                for (unsigned int i = 1; i < ways; i++)
+                    way = lru[i] < lru[way] ? i : way;
+            } else {
+                way = isa == ISA_AVX2 ? stampOldestAvx2(lru, ways)
+                                      : stampOldestSse4(lru, ways);
+            }
+            if (narrow) {
+                evict = tags32[way] != TAG_INVALID32;
+                tags32[way] = tag;
+            } else {
+                evict = tags[way] != TAG_INVALID;
+                tags[way] = tag;
+            }
+            misses++;
+            evictions += evict;
+            cache->fill[set] += !evict;
+        }
+        lru[way] = ++clock;
+        if (report)
+            reportAccess(cache, addr, match != 0, evict);
+        if (recs[r].op == 'M') {
+            hits++;
+            lru[way] = ++clock;
+            if (report)
+                reportModify(cache, addr);
+        }
+    }
+
+    cache->clock = clock;
+    cache->hits += hits;
+    cache->misses += misses;
+    cache->evictions += evictions;
+    if (r < n)
+        widenAndReplay(cache, recs + r, n - r);
+}
+
+#define SIMD_KERNEL(ways, isa, arch, narrow)                            \
+    static __attribute__((target(arch), flatten))                       \
+    void replay##ways##_##isa##_##narrow(cache_t* cache,                \
+                                         const trace_rec_t* recs, size_t n) \
+    {                                                                   \
+        replaySimd(cache, recs, n, ways, ISA_##isa, narrow);            \
+    }
+
+SIMD_KERNEL(4, SSE4, "sse4.2", 0) SIMD_KERNEL(4, SSE4, "sse4.2", 1)
+SIMD_KERNEL(8, SSE4, "sse4.2", 0) SIMD_KERNEL(8, SSE4, "sse4.2", 1)
+SIMD_KERNEL(16, SSE4, "sse4.2", 0) SIMD_KERNEL(16, SSE4, "sse4.2", 1)
+SIMD_KERNEL(4, AVX2, "avx2", 0) SIMD_KERNEL(4, AVX2, "avx2", 1)
+SIMD_KERNEL(8, AVX2, "avx2", 0) SIMD_KERNEL(8, AVX2, "avx2", 1)
+SIMD_KERNEL(16, AVX2, "avx2", 0) SIMD_KERNEL(16, AVX2, "avx2", 1)
+#endif /* TAGSCAN_SIMD */
+
+/* selectKernel - pick replayHashed() for a hashed cache, else the kernel
+ * specialized for E and for reporting outcomes or not, or the generic
+ * replayBatch() if there is none. Where the CPU has a SIMD kernel for
+ * the stride, it replaces the generic kernel and the ones for more than
+ * 8 ways; with fewer ways an early exit from the scalar scan is quicker.
+ * Kernels other than the SIMD ones need 64-bit tags.
+ */
+static replay_kernel_t selectKernel(cache_t* cache)
+{
+    static const struct {
+        int ways;
+        replay_kernel_t kernel[2];  /* quiet, reporting outcomes */
+    } kernels[] = {
+        { 1, { replay1_0, replay1_1 } },
+        { 2, { replay2_0, replay2_1 } },
+        { 4, { replay4_0, replay4_1 } },
+        { 8, { replay8_0, replay8_1 } },
+        { 16, { replay16_0, replay16_1 } },
+    };
+    replay_kernel_t kernel = replayBatch;
+
+    if (cache->hashed)
+        return replayHashed;
+    for (size_t i = 0; i < sizeof(kernels) / sizeof(kernels[0]); i++) {
+        if (kernels[i].ways == cache->E && cache->stride == (size_t)cache->E)
+            kernel = kernels[i].kernel[cache->verbose || cache->hit_bits != NULL];
+    }
+
+#ifdef TAGSCAN_SIMD
+    static const struct {
+        size_t ways;
+        replay_kernel_t kernel[2][2];   /* [isa][narrow] */
+    } simd_kernels[] = {
+        { 4, { { replay4_SSE4_0, replay4_SSE4_1 }, { replay4_AVX2_0, replay4_AVX2_1 } } },
+        { 8, { { replay8_SSE4_0, replay8_SSE4_1 }, { replay8_AVX2_0, replay8_AVX2_1 } } },
+        { 16, { { replay16_SSE4_0, replay16_SSE4_1 }, { replay16_AVX2_0, replay16_AVX2_1 } } },
+    };
+    int isa = __builtin_cpu_supports("avx2") ? ISA_AVX2 :
+              __builtin_cpu_supports("sse4.2") ? ISA_SSE4 : -1;
+
+    for (size_t i = 0; isa >= 0 && i < sizeof(simd_kernels) / sizeof(simd_kernels[0]); i++) {
+        if (simd_kernels[i].ways == cache->stride && (kernel == replayBatch || cache->E > 8))
+            return simd_kernels[i].kernel[isa][cache->narrow];
+    }
+#endif
+
+    if (cache->narrow)
+        widenTags(cache);
+    return kernel;
+}
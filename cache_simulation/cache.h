@@ -0,0 +1,67 @@
+/*
+ * cache.h - Simulated LRU caches
+ *
+ * A cache_t is one simulated cache together with its statistics. Caches
+ * share no state, so any number of them can be replayed at once, each
+ * on its own thread.
+ */
+
+#ifndef CACHELAB_CACHE_H
+#define CACHELAB_CACHE_H
+
+#include "trace.h"
+
+/* cacheCreate() flags */
+#define CACHE_VERBOSE    1  /* print the outcome of every access */
+#define CACHE_HUGE_PAGES 2  /* back the cache with huge pages */
+#define CACHE_REORDER    4  /* replay blocks of records bucketed by set */
+
+/* Tag of an empty line, in every engine: no address yields it, since
+ * s + b > 0
+ */
+#define TAG_INVALID (~(mem_addr_t)0)
+
+/* Line size of the host, which line arrays are aligned to */
+#define HOST_CACHE_LINE 64
+
+typedef struct cache cache_t;
+
+/* Type: Cache statistics */
+typedef struct cache_stats {
+    unsigned long long hits;
+    unsigned long long misses;
+    unsigned long long evictions;
+} cache_stats_t;
+
+/*
+ * cacheCreate - Create an empty cache of 2^s sets of E lines of 2^b
+ *               bytes. Returns NULL and sets errno on failure.
+ */
+cache_t* cacheCreate(int s, int E, int b, int flags);
+
+/*
+ * cacheReplay - Replay n trace records against the cache; an M record
+ *               is a load and a store to the same address.
+ */
+void cacheReplay(cache_t* cache, const trace_rec_t* recs, size_t n);
+
+/*
+ * cacheReplayOutcomes - Like cacheReplay(), but also set bit i of hit_bits
+ *                       (bit i % 8 of byte i / 8) if record i hit, clear
+ *                       it if it missed; for an M, the bit is its load.
+ *                       Replays in trace order even with CACHE_REORDER,
+ *                       and does not print with CACHE_VERBOSE.
+ */
+void cacheReplayOutcomes(cache_t* cache, const trace_rec_t* recs, size_t n,
+                         unsigned char* hit_bits);
+
+/*
+ * cacheStats - Get the hits, misses and evictions so far, replaying any
+ *              records CACHE_REORDER still holds back first
+ */
+void cacheStats(cache_t* cache, cache_stats_t* stats);
+
+/* cacheFree - Free the cache */
+void cacheFree(cache_t* cache);
+
+#endif /* CACHELAB_CACHE_H */
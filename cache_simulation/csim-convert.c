@@ -0,0 +1,104 @@
+/*
+ * csim-convert.c - Convert a trace in any format the simulator reads
+ *     (Valgrind lackey, DineroIV din, ChampSim, ...) into the compact
+ *     binary trace format described in trace.h.
+ *
+ * Instruction fetches are dropped, exactly as csim ignores them, so a
+ * converted trace replays to the same hits, misses and evictions as the
+ * text it came from.  csim recognizes converted traces by their magic
+ * number; pass them to -t like any other trace file.
+ */
+#include <getopt.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+
+#include "trace.h"
+
+/* printUsage - Print usage info */
+void printUsage(char* argv[])
+{
+    char names[256];
+
+    traceFormatNames(names, sizeof(names));
+    printf("Usage: %s [-h] [-f <fmt>] <trace> <output>\n", argv[0]);
+    printf("Options:\n");
+    printf("  -h         Print this help message.\n");
+    printf("  -f <fmt>   Trace format: %s (default: detect).\n", names);
+    printf("  <trace>    Trace file to convert.\n");
+    printf("  <output>   Binary trace to write, - for stdout.\n");
+    printf("\nExamples:\n");
+    printf("  linux>  %s traces/long.trace long.bin\n", argv[0]);
+    printf("  linux>  %s -f champsim 602.gcc.champsimtrace.xz gcc.bin\n", argv[0]);
+    printf("  linux>  ./csim -s 5 -E 1 -b 5 -t long.bin\n");
+}
+
+/* main - Main routine */
+int main(int argc, char* argv[])
+{
+    static trace_rec_t recs[TRACE_BATCH];
+    static unsigned char out[TRACE_BATCH * TRACE_BIN_MAX_REC];
+    unsigned char header[TRACE_BIN_HEADER_LEN];
+    const trace_format_t* format = NULL;
+    mem_addr_t prev = 0;
+    unsigned long long count = 0, bytes = TRACE_BIN_HEADER_LEN;
+    size_t n;
+    int c;
+
+    while ((c = getopt(argc, argv, "f:h")) != -1) {
+        switch (c) {
+        case 'f':
+            format = traceFindFormat(optarg);
+            if (format == NULL) {
+                printf("%s: Unknown trace format %s\n", argv[0], optarg);
+                printUsage(argv);
+                exit(1);
+            }
+            break;
+        case 'h':
+            printUsage(argv);
+            exit(0);
+        default:
+            printUsage(argv);
+            exit(1);
+        }
+    }
+    if (argc - optind != 2) {
+        printf("%s: Missing required command line argument\n", argv[0]);
+        printUsage(argv);
+        exit(1);
+    }
+
+    char* in_fn = argv[optind];
+    char* out_fn = argv[optind + 1];
+    trace_reader_t* reader = traceOpenFormat(in_fn, format);
+    if (reader == NULL) {
+        printf("%s: %s\n", in_fn, strerror(errno));
+        exit(1);
+    }
+    FILE* out_fp = strcmp(out_fn, "-") == 0 ? stdout : fopen(out_fn, "wb");
+    if (out_fp == NULL) {
+        printf("%s: %s\n", out_fn, strerror(errno));
+        exit(1);
+    }
+
+    traceEncodeHeader(header);
+    fwrite(header, 1, sizeof(header), out_fp);
+    while ((n = traceRead(reader, recs, TRACE_BATCH)) > 0) {
+        size_t len = traceEncode(recs, n, &prev, out);
+        if (fwrite(out, 1, len, out_fp) != len)
+            break;
+        count += n;
+        bytes += len;
+    }
+    traceClose(reader);
+
+    if (ferror(out_fp) || fclose(out_fp) != 0) {
+        printf("%s: write failed\n", out_fn);
+        exit(1);
+    }
+    fprintf(stderr, "%llu records, %llu bytes\n", count, bytes);
+    return 0;
+}
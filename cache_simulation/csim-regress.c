@@ -0,0 +1,359 @@
+/*
+ * csim-regress.c - Regression runner for the cache simulator
+ *
+ * Checks the simulator against stored answers of the reference
+ * simulator without starting a process per case: the traces are
+ * decoded once, in memory, and every case runs on a pool of threads
+ * through libcsim, like csim. The answers file has one case per line,
+ *
+ *   trace s E b points hits misses evictions
+ *
+ * where points are what test-csim awards for the case (0 for cases it
+ * does not grade). Lines starting with # are comments. -g recomputes
+ * the counts with the reference simulator, one run per case, and
+ * writes the file anew; the counts of a new case can be left out until
+ * then.
+ */
+#define _POSIX_C_SOURCE 200809L
+
+#include <getopt.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include <time.h>
+
+#include "libcsim.h"
+#include "trace.h"
+
+/* Default answers file */
+#define REGRESS_ANSWERS "traces/answers"
+
+/* Type: A trace the cases replay, decoded once */
+typedef struct regress_trace {
+    char* fn;
+    trace_rec_t* recs;
+    size_t nrecs;
+    int err;
+    double elapsed;
+} regress_trace_t;
+
+/* Type: One case and how it went */
+typedef struct regress_case {
+    int trace;      /* index into traces */
+    int s, E, b;
+    int points;
+    cache_stats_t want, got;
+    int err;
+    double elapsed;
+} regress_case_t;
+
+static regress_trace_t* traces;
+static int ntraces;
+static regress_case_t* cases;
+static int ncases;
+static int cache_flags;
+
+/* Type: Work handed out to the pool, one index at a time */
+typedef struct regress_pool {
+    void (*run)(int i);
+    int n;
+    int next;
+} regress_pool_t;
+
+/* now - seconds on a monotonic clock */
+static double now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* loadOne - decode trace i */
+static void loadOne(int i)
+{
+    regress_trace_t* t = &traces[i];
+    double start = now();
+
+    if (traceLoad(t->fn, NULL, &t->recs, &t->nrecs) != 0)
+        t->err = errno;
+    t->elapsed = now() - start;
+}
+
+/* runOne - simulate case i */
+static void runOne(int i)
+{
+    regress_case_t* c = &cases[i];
+    regress_trace_t* t = &traces[c->trace];
+    csim_config_t config = { c->s, c->E, c->b, cache_flags, 1 };
+    double start = now();
+    csim_t* sim;
+
+    if (t->err != 0) {
+        c->err = t->err;
+        return;
+    }
+    sim = csimCreate(&config);
+    if (sim == NULL) {
+        c->err = errno;
+        return;
+    }
+    csimAccessBatch(sim, t->recs, t->nrecs);
+    csimStats(sim, &c->got);
+    csimFree(sim);
+    c->elapsed = now() - start;
+}
+
+/* poolMain - run the pool's items until there are none left */
+static void* poolMain(void* arg)
+{
+    regress_pool_t* pool = (regress_pool_t*)arg;
+    int i;
+
+    while ((i = __atomic_fetch_add(&pool->next, 1, __ATOMIC_RELAXED)) < pool->n)
+        pool->run(i);
+    return NULL;
+}
+
+/* runPool - run items 0 to n - 1 on up to threads threads */
+static void runPool(void (*run)(int i), int n, int threads)
+{
+    regress_pool_t pool = { run, n, 0 };
+    pthread_t tids[64];
+    int started = 0;
+
+    if (threads > n)
+        threads = n;
+    if (threads > 64)
+        threads = 64;
+    /* The calling thread is one of them */
+    while (started < threads - 1 &&
+           pthread_create(&tids[started], NULL, poolMain, &pool) == 0)
+        started++;
+    poolMain(&pool);
+    for (int i = 0; i < started; i++)
+        pthread_join(tids[i], NULL);
+}
+
+/* findTrace - index of a trace, added if it is new */
+static int findTrace(const char* fn)
+{
+    for (int i = 0; i < ntraces; i++) {
+        if (strcmp(traces[i].fn, fn) == 0)
+            return i;
+    }
+    if ((ntraces & (ntraces - 1)) == 0) {
+        regress_trace_t* grown = (regress_trace_t*)realloc(traces,
+                (ntraces ? 2 * ntraces : 8) * sizeof(regress_trace_t));
+
+        if (grown == NULL)
+            return -1;
+        traces = grown;
+    }
+    memset(&traces[ntraces], 0, sizeof(regress_trace_t));
+    traces[ntraces].fn = strdup(fn);
+    if (traces[ntraces].fn == NULL)
+        return -1;
+    return ntraces++;
+}
+
+/*
+ * readAnswers - Read the cases of an answers file; with partial set,
+ *               the counts may be missing. Returns -1 and prints why
+ *               on failure.
+ */
+static int readAnswers(const char* fn, int partial)
+{
+    FILE* fp = fopen(fn, "r");
+    char line[1024], trace[512];
+    int lineno = 0;
+
+    if (fp == NULL) {
+        printf("%s: %s\n", fn, strerror(errno));
+        return -1;
+    }
+    while (fgets(line, sizeof(line), fp) != NULL) {
+        regress_case_t c;
+        int fields;
+
+        lineno++;
+        if (line[0] == '#' || strspn(line, " \t\r\n") == strlen(line))
+            continue;
+        memset(&c, 0, sizeof(c));
+        fields = sscanf(line, "%511s %d %d %d %d %llu %llu %llu", trace, &c.s, &c.E,
+                        &c.b, &c.points, &c.want.hits, &c.want.misses, &c.want.evictions);
+        if (fields != 8 && !(partial && fields == 5)) {
+            printf("%s:%d: Expected trace s E b points hits misses evictions\n", fn, lineno);
+            fclose(fp);
+            return -1;
+        }
+        c.trace = findTrace(trace);
+        if ((ncases & (ncases - 1)) == 0) {
+            regress_case_t* grown = (regress_case_t*)realloc(cases,
+                    (ncases ? 2 * ncases : 64) * sizeof(regress_case_t));
+
+            if (grown == NULL)
+                c.trace = -1;
+            else
+                cases = grown;
+        }
+        if (c.trace < 0) {
+            printf("%s: %s\n", fn, strerror(ENOMEM));
+            fclose(fp);
+            return -1;
+        }
+        cases[ncases++] = c;
+    }
+    fclose(fp);
+    return 0;
+}
+
+/*
+ * writeAnswers - Run the reference simulator for every case and print
+ *                the answers file to stdout. Returns -1 and prints why
+ *                if a run fails.
+ */
+static int writeAnswers(const char* ref)
+{
+    char cmd[1024], out[256];
+
+    for (int i = 0; i < ncases; i++) {
+        regress_case_t* c = &cases[i];
+        FILE* p;
+        int found = 0;
+
+        snprintf(cmd, sizeof(cmd), "%s -s %d -E %d -b %d -t '%s'", ref, c->s, c->E, c->b,
+                 traces[c->trace].fn);
+        p = popen(cmd, "r");
+        if (p == NULL) {
+            printf("%s: %s\n", cmd, strerror(errno));
+            return -1;
+        }
+        while (fgets(out, sizeof(out), p) != NULL) {
+            found |= sscanf(out, "hits:%llu misses:%llu evictions:%llu", &c->want.hits,
+                            &c->want.misses, &c->want.evictions) == 3;
+        }
+        if (pclose(p) != 0 || !found) {
+            printf("%s: Reference simulator failed\n", cmd);
+            return -1;
+        }
+    }
+
+    /* Nothing is printed unless every run worked */
+    printf("# Reference answers for csim-regress, written by\n");
+    printf("#   ./csim-regress -g %s\n", ref);
+    printf("# trace s E b points hits misses evictions\n");
+    for (int i = 0; i < ncases; i++) {
+        regress_case_t* c = &cases[i];
+
+        printf("%s %d %d %d %d %llu %llu %llu\n", traces[c->trace].fn, c->s, c->E, c->b,
+               c->points, c->want.hits, c->want.misses, c->want.evictions);
+    }
+    return 0;
+}
+
+/* printUsage - Print usage info */
+void printUsage(char* argv[])
+{
+    printf("Usage: %s [-hqR] [-j <num>] [-a <file>]\n", argv[0]);
+    printf("       %s -g <ref> [-a <file>]\n", argv[0]);
+    printf("Options:\n");
+    printf("  -h         Print this help message.\n");
+    printf("  -a <file>  Answers file (default: %s).\n", REGRESS_ANSWERS);
+    printf("  -j <num>   Threads (default: one per CPU).\n");
+    printf("  -q         Only print failed cases and the summary.\n");
+    printf("  -R         Replay with csim's -R (reordered by set).\n");
+    printf("  -g <ref>   Print the answers file with the counts of\n");
+    printf("             reference simulator <ref> and exit.\n");
+    printf("\nExamples:\n");
+    printf("  linux>  %s\n", argv[0]);
+    printf("  linux>  %s -g ./csim-ref > answers.new\n", argv[0]);
+}
+
+/* main - Main routine */
+int main(int argc, char* argv[])
+{
+    const char* answers = REGRESS_ANSWERS;
+    const char* ref = NULL;
+    int threads = 0, quiet = 0, failed = 0, points = 0, max_points = 0;
+    double start;
+    int c;
+
+    while ((c = getopt(argc, argv, "a:g:j:qRh")) != -1) {
+        switch (c) {
+        case 'a':
+            answers = optarg;
+            break;
+        case 'g':
+            ref = optarg;
+            break;
+        case 'j':
+            threads = atoi(optarg);
+            break;
+        case 'q':
+            quiet = 1;
+            break;
+        case 'R':
+            cache_flags |= CACHE_REORDER;
+            break;
+        case 'h':
+            printUsage(argv);
+            exit(0);
+        default:
+            printUsage(argv);
+            exit(1);
+        }
+    }
+    if (readAnswers(answers, ref != NULL) != 0)
+        exit(1);
+    if (ref != NULL)
+        exit(writeAnswers(ref) == 0 ? 0 : 1);
+    if (threads <= 0)
+        threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    if (threads <= 0)
+        threads = 1;
+
+    start = now();
+    runPool(loadOne, ntraces, threads);
+    runPool(runOne, ncases, threads);
+    double elapsed = now() - start;
+
+    for (int i = 0; i < ntraces; i++) {
+        regress_trace_t* t = &traces[i];
+
+        if (t->err != 0)
+            printf("%s: %s\n", t->fn, strerror(t->err));
+        else if (!quiet)
+            printf("%-20s %9zu records, decoded in %8.3f ms\n", t->fn, t->nrecs, 1e3 * t->elapsed);
+    }
+    for (int i = 0; i < ncases; i++) {
+        regress_case_t* k = &cases[i];
+        int ok = k->err == 0 && k->got.hits == k->want.hits &&
+                 k->got.misses == k->want.misses && k->got.evictions == k->want.evictions;
+
+        max_points += k->points;
+        if (ok) {
+            points += k->points;
+        } else {
+            failed++;
+        }
+        if (ok && quiet)
+            continue;
+        printf("%-4s %8.3f ms  %-20s (%d,%d,%d)", ok ? "ok" : "FAIL", 1e3 * k->elapsed,
+               traces[k->trace].fn, k->s, k->E, k->b);
+        if (k->err != 0)
+            printf("  %s\n", strerror(k->err));
+        else if (!ok)
+            printf("  got %llu %llu %llu, expected %llu %llu %llu\n", k->got.hits,
+                   k->got.misses, k->got.evictions, k->want.hits, k->want.misses,
+                   k->want.evictions);
+        else
+            printf("  %llu %llu %llu\n", k->got.hits, k->got.misses, k->got.evictions);
+    }
+    printf("%d cases, %d failed, %d of %d points, %.3f ms on %d threads\n",
+           ncases, failed, points, max_points, 1e3 * elapsed, threads);
+    return failed == 0 ? 0 : 1;
+}
@@ -16,6 +16,8 @@
  * Please use this function to print the number of hits, misses, and evictions.
  * This is crucial for the driver to evaluate your work. 
  */
+#define _DEFAULT_SOURCE /* getopt_long */
+
 #include <getopt.h>
 #include <stdlib.h>
 #include <unistd.h>
@@ -26,8 +28,17 @@
 #include <string.h>
 #include <errno.h>
 #include <stdbool.h>
+#include <time.h>
 
+#include "allassoc.h"
+#include "cache.h"
 #include "cachelab.h"
+#include "libcsim.h"
+#include "pipeline.h"
+#include "results.h"
+#include "stackdist.h"
+#include "sweep.h"
+#include "trace.h"
 
 // #define DEBUG_ON 
 #define ADDRESS_LENGTH 64
@@ -52,181 +63,424 @@ int hit_count = 0;
 int eviction_count = 0;
 /*****************************************************************************/
 
+/* Further command line options */
+const trace_format_t* trace_format = NULL; /* trace format, NULL: detect (-f) */
+int use_pipeline = 0; /* decode the trace on its own thread (-P) */
+int use_huge_pages = 0; /* back the cache with huge pages (-H) */
+int reorder = 0; /* replay blocks of records bucketed by set (-R) */
+int stack_distances = 0; /* print misses of every fully-associative capacity (-D) */
+int all_assoc = 0; /* print every associativity up to this one (-A) */
+int all_assoc_smax = -1; /* with -A, also every s from 0 to this (-S) */
+char* sweep_spec = NULL; /* grid of configurations to simulate (--sweep) */
+int threads = 0; /* simulator threads (-j); 0: one per CPU in a sweep, else one */
+char* results_format = NULL; /* rows of results instead of the summary (--results) */
+char* results_file = NULL; /* stream of the rows, - for stdout (-o) */
 
-/* Type: Memory address 
- * Use this type whenever dealing with addresses or address masks
- */
-typedef unsigned long long int mem_addr_t;
 
-/* Type: Cache line
- * Added LRU counter field to implement LRU policy
- */
-typedef struct cache_line {
-    char valid;
-    mem_addr_t tag;
-    int lru_counter; // To keep track of Least Recently Used line
-} cache_line_t;
+/* The cache we are simulating */
+csim_t* sim = NULL;
 
-typedef cache_line_t* cache_set_t;
-typedef cache_set_t* cache_t;
+/* Its counts, which hit_count and friends hold truncated to int */
+cache_stats_t totals;
 
-/* The cache we are simulating */
-cache_t cache;  
+/* Records replayTrace() has replayed */
+unsigned long long records_replayed = 0;
+
+/* Where rows of results go, with --results */
+results_t* results = NULL;
+FILE* results_fp = NULL;
 
 /* initCache - 
  * Allocate data structures to hold info regarding the sets and cache lines
- * Initialize valid and tag field with 0s.
  * calculate S = 2^s
  * use S and E while allocating the data structures here
  */
 void initCache() {
-    S = pow(2, s);  // Number of sets
-    cache = (cache_set_t *)malloc(S * sizeof(cache_set_t));
-    for (int i = 0; i < S; i++) {
-        cache[i] = (cache_line_t *)malloc(E * sizeof(cache_line_t));
-        for (int j = 0; j < E; j++) {
-            cache[i][j].valid = 0;  // Initialize valid bit to 0
-            cache[i][j].tag = 0;    // Initialize tag to 0
-            cache[i][j].lru_counter = 0;  // Initialize LRU counter
-        }
+    S = 1 << s;  // Number of sets
+    B = 1 << b;  // Block size
+
+    csim_config_t config = { s, E, b, 0, threads };
+
+    config.flags = (verbosity ? CACHE_VERBOSE : 0) | (use_huge_pages ? CACHE_HUGE_PAGES : 0) |
+                   (reorder ? CACHE_REORDER : 0);
+    sim = csimCreate(&config);
+    if (sim == NULL) {
+        printf("Cannot allocate a cache of %d sets of %d lines\n", S, E);
+        exit(1);
     }
 }
 
-/* freeCache - free each piece of memory you allocated using malloc 
- * inside initCache() function
+/* collectStats - wait for the simulation to finish and copy its counts
+ * into hit_count, miss_count and eviction_count
  */
-void freeCache() {
-    for (int i = 0; i < S; i++) {
-        free(cache[i]);
-    }
-    free(cache);
+static void collectStats(void) {
+    csimStats(sim, &totals);
+    hit_count = (int)totals.hits;
+    miss_count = (int)totals.misses;
+    eviction_count = (int)totals.evictions;
 }
 
-/* updateLRU - Update the LRU counters for a given set.
- * For each access, increase the counter of other cache lines and reset the one being accessed.
+/* freeCache - free the memory allocated inside initCache() function
  */
-void updateLRU(int setIndex, int lineIndex) {
-    for (int i = 0; i < E; i++) {
-        if (i != lineIndex && cache[setIndex][i].valid) {
-            cache[setIndex][i].lru_counter++; // Increase counter for all other lines
-        }
-    }
-    cache[setIndex][lineIndex].lru_counter = 0;  // Reset LRU counter for accessed line
+void freeCache() {
+    csimFree(sim);
+    sim = NULL;
 }
 
-/* accessData - Access data at memory address addr.
- *   If it is already in cache, increase hit_count
- *   If it is not in cache, bring it in cache, increase miss count.
- *   Also increase eviction_count if a line is evicted.
- *   Implement Least-Recently-Used (LRU) cache replacement policy
+/* Type: Replay kernel
+ * Replays a batch of records against whatever is being simulated
  */
-void accessData(mem_addr_t addr) {
-    mem_addr_t tag = addr >> (s + b);  // Extract the tag from the address
-    int setIndex = (addr >> b) & ((1 << s) - 1);  // Extract the set index
-
-    int hit = 0;
-    int empty_index = -1;
-    int lru_index = 0;
-    int max_lru = -1;
-
-    // Check for hits, find empty slots, or determine LRU line
-    for (int i = 0; i < E; i++) {
-        if (cache[setIndex][i].valid) {
-            if (cache[setIndex][i].tag == tag) {
-                hit = 1;
-                hit_count++;  // Cache hit
-                updateLRU(setIndex, i); // Update LRU counter for the accessed line
-                break;
-            } else if (cache[setIndex][i].lru_counter > max_lru) {
-                max_lru = cache[setIndex][i].lru_counter;
-                lru_index = i;  // Track the least recently used line
-            }
-        } else if (empty_index == -1) {
-            empty_index = i;  // Find the first empty slot
+typedef void (*replay_kernel_t)(const trace_rec_t* recs, size_t n);
+
+/* replayCache - replays a batch of records against the cache */
+static void replayCache(const trace_rec_t* recs, size_t n) {
+    csimAccessBatch(sim, recs, n);
+}
+
+/* Stack distances of the trace, in -D mode */
+stackdist_t* stack_dist = NULL;
+
+/* replayStackDist - records the stack distance of every access */
+static void replayStackDist(const trace_rec_t* recs, size_t n) {
+    for (size_t i = 0; i < n; i++) {
+        int err = stackdistAccess(stack_dist, recs[i].addr);
+
+        if (err == 0 && recs[i].op == 'M') {
+            err = stackdistAccess(stack_dist, recs[i].addr);
+        }
+        if (err != 0) {
+            printf("Stack distances: %s\n", strerror(errno));
+            exit(1);
         }
     }
+}
 
-    if (!hit) {
-        miss_count++;
-        if (empty_index != -1) {
-            // Place the new line in the empty cache slot
-            cache[setIndex][empty_index].valid = 1;
-            cache[setIndex][empty_index].tag = tag;
-            updateLRU(setIndex, empty_index);
-        } else {
-            // Evict the least recently used line
-            eviction_count++;
-            cache[setIndex][lru_index].tag = tag;
-            updateLRU(setIndex, lru_index);
+/* All-associativity caches, in -A mode */
+allassoc_t* all_assoc_sim = NULL;
+
+/* replayAllAssoc - replays a batch against every associativity */
+static void replayAllAssoc(const trace_rec_t* recs, size_t n) {
+    for (size_t i = 0; i < n; i++) {
+        allassocAccess(all_assoc_sim, recs[i].addr);
+        if (recs[i].op == 'M') {
+            allassocAccess(all_assoc_sim, recs[i].addr);
         }
     }
+}
 
-    // Verbose mode output
-    if (verbosity) {
-        printf("Address: %llx - ", addr);
-        if (hit) {
-            printf("hit\n");
-        } else {
-            printf("miss");
-            if (empty_index == -1) {
-                printf(" eviction");
-            }
-            printf("\n");
+/* The whole trace, decoded, in --sweep mode */
+trace_rec_t* loaded = NULL;
+size_t loaded_len = 0;
+size_t loaded_cap = 0;
+
+/* replayLoad - appends a batch of records to the loaded trace */
+static void replayLoad(const trace_rec_t* recs, size_t n) {
+    if (loaded_len + n > loaded_cap) {
+        size_t cap = loaded_cap ? 2 * loaded_cap : 16 * TRACE_BATCH;
+        while (cap < loaded_len + n) {
+            cap *= 2;
         }
+        trace_rec_t* grown = (trace_rec_t*)realloc(loaded, cap * sizeof(trace_rec_t));
+        if (grown == NULL) {
+            printf("%s: %s\n", trace_file, strerror(ENOMEM));
+            exit(1);
+        }
+        loaded = grown;
+        loaded_cap = cap;
     }
+    memcpy(loaded + loaded_len, recs, n * sizeof(trace_rec_t));
+    loaded_len += n;
 }
 
+/* The kernel replayTrace() uses */
+replay_kernel_t replay = replayCache;
+
 /* replayTrace - replays the given trace file against the cache 
- * reads the input trace file line by line
+ * maps the input trace file (or streams it, for "-" and pipes) and
+ * decodes it a batch of records at a time
  * extracts the type of each memory access : L/S/M
  * "L" -> load, "S" -> store, "M" -> modify (load + store)
- * Ignore instruction fetch "I"
+ * Ignore instruction fetch "I" (the reader drops those lines)
+ * With use_pipeline set, decoding runs on its own thread.
+ * Batches go to the replay kernel.
  */
 void replayTrace(char* trace_fn) {
-    char buf[1000];
-    mem_addr_t addr = 0;
-    unsigned int len = 0;
-    FILE* trace_fp = fopen(trace_fn, "r");
-
-    while (fgets(buf, 1000, trace_fp) != NULL) {
-        if (buf[1] == 'S' || buf[1] == 'L' || buf[1] == 'M') {
-            sscanf(buf + 3, "%llx,%u", &addr, &len);
-            accessData(addr);  // Call accessData for each memory access
-            if (buf[1] == 'M') {
-                accessData(addr);  // For 'M' operation, access twice
+    trace_rec_t recs[TRACE_BATCH];
+    const trace_rec_t* batch;
+    size_t n;
+    trace_reader_t* reader = traceOpenFormat(trace_fn, trace_format);
+
+    if (reader == NULL) {
+        printf("%s: %s\n", trace_fn, strerror(errno));
+        exit(1);
+    }
+
+    if (use_pipeline) {
+        pipeline_stats_t stats;
+        pipeline_t* pl = pipelineStart(reader);
+
+        if (pl == NULL) {
+            printf("%s: %s\n", trace_fn, strerror(errno));
+            exit(1);
+        }
+        while ((batch = pipelineNext(pl, &n)) != NULL) {
+            replay(batch, n);
+            records_replayed += n;
+        }
+        pipelineStop(pl, &stats);
+        fprintf(stderr, "pipeline: %llu batches, ring occupancy %.1f/%d, "
+                "reader stalled %llu times, simulator stalled %llu times\n",
+                stats.batches, stats.avg_occupancy, PIPELINE_SLOTS,
+                stats.full_stalls, stats.empty_stalls);
+    } else {
+        while ((n = traceRead(reader, recs, TRACE_BATCH)) > 0) {
+            replay(recs, n);
+            records_replayed += n;
+        }
+    }
+
+    if (traceError(reader) != 0) {
+        printf("%s: %s\n", trace_fn, strerror(traceError(reader)));
+        exit(1);
+    }
+    traceClose(reader);
+}
+
+/* now - seconds on a monotonic clock */
+static double now(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* openResults - start the --results rows, appending to results_file
+ * or writing to stdout
+ */
+static void openResults(void) {
+    if (results_file == NULL || strcmp(results_file, "-") == 0) {
+        results_fp = stdout;
+    } else {
+        results_fp = fopen(results_file, "a");
+        if (results_fp == NULL) {
+            printf("%s: %s\n", results_file, strerror(errno));
+            exit(1);
+        }
+    }
+    results = resultsOpen(results_format, results_fp);
+    if (results == NULL) {
+        printf("Results %s: %s\n", results_format, strerror(errno));
+        exit(1);
+    }
+}
+
+/* writeResult - write a --results row for a cache simulated in elapsed
+ * seconds, along with accesses others (0: none)
+ */
+static void writeResult(int set_bits, int ways, int block_bits, const cache_stats_t* stats,
+                        int err, double elapsed, unsigned long long accesses) {
+    results_row_t row = { trace_file, set_bits, ways, block_bits, *stats,
+                          records_replayed, elapsed, accesses, err };
+
+    if (resultsWrite(results, &row) != 0) {
+        printf("%s: %s\n", results_file ? results_file : "-", strerror(errno));
+        exit(1);
+    }
+}
+
+/* closeResults - finish the --results rows */
+static void closeResults(void) {
+    if (resultsClose(results) != 0) {
+        printf("%s: %s\n", results_file ? results_file : "-", strerror(errno));
+        exit(1);
+    }
+    if (results_fp != stdout) {
+        fclose(results_fp);
+    }
+    results = NULL;
+}
+
+/* printMissCurve - print the hits, misses and evictions of a
+ * fully-associative LRU cache of each capacity E from one line up to
+ * the first that only has compulsory misses, one line per capacity.
+ * A cache of E lines misses on every access at distance E or more and
+ * evicts on every miss once it holds E blocks. With --results, writes
+ * them as rows instead, s being 0.
+ */
+static void printMissCurve(double elapsed) {
+    const unsigned long long* hist;
+    size_t len = stackdistHistogram(stack_dist, &hist);
+    unsigned long long accesses = stackdistAccesses(stack_dist);
+    unsigned long long blocks = stackdistBlocks(stack_dist);
+    unsigned long long misses = accesses;   /* with no lines at all */
+
+    for (size_t lines = 1; lines <= len || lines == 1; lines++) {
+        unsigned long long fills = lines < blocks ? lines : blocks;
+
+        if (lines <= len) {
+            misses -= hist[lines - 1];
+        }
+        if (results != NULL) {
+            cache_stats_t stats = { accesses - misses, misses, misses - fills };
+
+            writeResult(0, (int)lines, b, &stats, 0, elapsed, 0);
+            continue;
+        }
+        printf("E:%zu hits:%llu misses:%llu evictions:%llu\n",
+               lines, accesses - misses, misses, misses - fills);
+    }
+}
+
+/* printAllAssoc - print the hits, misses and evictions of every cache
+ * simulated in -A mode, one line (or --results row) per cache
+ */
+static void printAllAssoc(int smin, int smax, double elapsed) {
+    for (int set_bits = smin; set_bits <= smax; set_bits++) {
+        for (int ways = 1; ways <= all_assoc; ways++) {
+            unsigned long long hits, misses, evictions;
+
+            allassocResult(all_assoc_sim, set_bits, ways, &hits, &misses, &evictions);
+            if (results != NULL) {
+                cache_stats_t stats = { hits, misses, evictions };
+
+                writeResult(set_bits, ways, b, &stats, 0, elapsed, 0);
+                continue;
             }
+            printf("s:%d E:%d hits:%llu misses:%llu evictions:%llu\n",
+                   set_bits, ways, hits, misses, evictions);
+        }
+    }
+}
+
+/* runSweep - load the trace, simulate every configuration of the sweep
+ * on it and print one line (or --results row) per configuration, in
+ * grid order. Rows carry the time and throughput of the whole sweep,
+ * since configurations share workers and split across them.
+ */
+static void runSweep(void) {
+    sweep_config_t* configs;
+    sweep_stats_t stats;
+    unsigned long long swept = 0;   /* accesses of all configurations */
+    size_t n = sweepParse(sweep_spec, s, E ? E : -1, b ? b : -1, &configs);
+
+    if (n == 0) {
+        printf("Sweep %s: %s\n", sweep_spec, strerror(errno));
+        exit(1);
+    }
+    replay = replayLoad;
+    replayTrace(trace_file);
+
+    if (sweepRun(configs, n, loaded, loaded_len, threads, &stats) != 0) {
+        printf("Sweep %s: %s\n", sweep_spec, strerror(errno));
+        exit(1);
+    }
+
+    for (size_t i = 0; results != NULL && i < n; i++) {
+        swept += configs[i].stats.hits + configs[i].stats.misses;
+    }
+    for (size_t i = 0; i < n; i++) {
+        sweep_config_t* config = &configs[i];
+
+        if (results != NULL) {
+            writeResult(config->s, config->E, config->b, &config->stats, config->err,
+                        stats.elapsed, swept);
+            continue;
+        }
+        printf("s:%d E:%d b:%d ", config->s, config->E, config->b);
+        if (config->err != 0) {
+            printf("error:%s\n", strerror(config->err));
+        } else {
+            printf("hits:%llu misses:%llu evictions:%llu\n", config->stats.hits,
+                   config->stats.misses, config->stats.evictions);
         }
     }
-    fclose(trace_fp);
+    fflush(stdout);
+    fprintf(stderr, "sweep: %zu configurations of %zu records in %.3f s\n",
+            n, loaded_len, stats.elapsed);
+    for (int i = 0; stats.worker != NULL && i < stats.workers; i++) {
+        sweep_worker_stats_t* w = &stats.worker[i];
+
+        fprintf(stderr, "worker %d: %llu jobs, %llu stolen, %llu split, "
+                "%.3f s busy (%.0f%%)\n", i, w->jobs, w->steals, w->splits,
+                w->busy, stats.elapsed > 0 ? 100 * w->busy / stats.elapsed : 0);
+    }
+    free(stats.worker);
+    free(configs);
+    free(loaded);
 }
 
 /* printUsage - Print usage info */
 void printUsage(char* argv[])
 {
-    printf("Usage: %s [-hv] -s <num> -E <num> -b <num> -t <file>\n", argv[0]);
+    char names[256];
+
+    traceFormatNames(names, sizeof(names));
+    printf("Usage: %s [-hvPHR] [-j <num>] [-p <num>] [-f <fmt>] -s <num> -E <num> -b <num> -t <file>\n", argv[0]);
+    printf("       %s -D [-hP] [-p <num>] [-f <fmt>] -b <num> -t <file>\n", argv[0]);
+    printf("       %s -A <num> [-hP] [-p <num>] [-f <fmt>] -s <num>|-S <num> -b <num> -t <file>\n", argv[0]);
+    printf("       %s --sweep <grid> [-hP] [-j <num>] [-p <num>] [-f <fmt>] [-s <num>] [-E <num>] [-b <num>] -t <file>\n", argv[0]);
     printf("Options:\n");
     printf("  -h         Print this help message.\n");
     printf("  -v         Optional verbose flag.\n");
-    printf("  -s <num>   Number of set index bits.\n");
+    printf("  -s <num>   Number of set index bits (0: fully associative).\n");
     printf("  -E <num>   Number of lines per set.\n");
     printf("  -b <num>   Number of block offset bits.\n");
-    printf("  -t <file>  Trace file.\n");
+    printf("  -t <file>  Trace file, - for stdin.\n");
+    printf("  -f <fmt>   Trace format: %s (default: detect).\n", names);
+    printf("  -p <num>   Trace parser threads (default: one per CPU).\n");
+    printf("  -P         Decode the trace on its own thread and print\n");
+    printf("             reader/simulator pipeline stats to stderr.\n");
+    printf("  -H         Back the simulated cache with huge pages.\n");
+    printf("  -R         Replay blocks of the trace reordered by set (not with -v).\n");
+    printf("  -D         Print the hits, misses and evictions of a fully-associative\n");
+    printf("             cache of every size E, from one pass over the trace.\n");
+    printf("  -A <num>   Print the hits, misses and evictions of every E from 1 to\n");
+    printf("             <num>, from one pass over the trace.\n");
+    printf("  -S <num>   With -A, do so for every s from 0 to <num>.\n");
+    printf("  --sweep <grid>\n");
+    printf("             Print the hits, misses and evictions of every configuration\n");
+    printf("             of the grid, e.g. s=1..12,E=1,2,4,8,b=3..7; s, E or b left\n");
+    printf("             out of it are taken from -s, -E or -b. Per-thread\n");
+    printf("             utilization goes to stderr.\n");
+    printf("  -j <num>   Simulate on this many threads, each owning a slice of the\n");
+    printf("             sets (default: one; in a sweep, one per CPU).\n");
+    printf("  --results <fmt>\n");
+    printf("             Instead of the summary (and .csim_results), write a row of\n");
+    printf("             64-bit counts, records, seconds and accesses/sec per cache\n");
+    printf("             as json (lines) or csv.\n");
+    printf("  -o <file>  Append the --results rows (default: json) to <file>\n");
+    printf("             instead of stdout.\n");
     printf("\nExamples:\n");
     printf("  linux>  %s -s 4 -E 1 -b 4 -t traces/yi.trace\n", argv[0]);
     printf("  linux>  %s -v -s 8 -E 2 -b 4 -t traces/yi.trace\n", argv[0]);
+    printf("  linux>  %s -f din -s 4 -E 1 -b 4 -t cc1.din\n", argv[0]);
+    printf("  linux>  %s -s 0 -E 65536 -b 6 -t traces/long.trace\n", argv[0]);
+    printf("  linux>  %s -j 4 -s 12 -E 8 -b 6 -t traces/long.trace\n", argv[0]);
+    printf("  linux>  %s -D -b 6 -t traces/long.trace\n", argv[0]);
+    printf("  linux>  %s -A 16 -S 10 -b 6 -t traces/long.trace\n", argv[0]);
+    printf("  linux>  %s --sweep s=1..12,E=1,2,4,8,b=3..7 -t traces/long.trace\n", argv[0]);
+    printf("  linux>  %s --results csv -o runs.csv -s 4 -E 1 -b 4 -t traces/yi.trace\n", argv[0]);
+    printf("  linux>  valgrind --tool=lackey --trace-mem=yes ls 2>&1 | %s -s 4 -E 1 -b 4 -t -\n", argv[0]);
     exit(0);
 }
 
 /* main - Main routine */
 int main(int argc, char* argv[])
 {
-    char c;
+    static const struct option long_options[] = {
+        { "sweep", required_argument, NULL, 'W' },
+        { "results", required_argument, NULL, 'O' },
+        { NULL, 0, NULL, 0 }
+    };
+    int c;
+    int s_given = 0;    /* -s 0 is valid: a fully-associative cache */
     
-    // Parse the command line arguments: -h, -v, -s, -E, -b, -t 
-    while( (c=getopt(argc,argv,"s:E:b:t:vh")) != -1){
+    // Parse the command line arguments: -h, -v, -s, -E, -b, -t, -f, -p, -j, -o, -P, -H, -R, -D, -A, -S, --sweep, --results
+    while( (c=getopt_long(argc,argv,"s:E:b:t:f:p:j:o:A:S:vPHRDh",long_options,NULL)) != -1){
         switch(c){
         case 's':
             s = atoi(optarg);
+            s_given = 1;
             break;
         case 'E':
             E = atoi(optarg);
@@ -237,9 +491,50 @@ int main(int argc, char* argv[])
         case 't':
             trace_file = optarg;
             break;
+        case 'f':
+            trace_format = traceFindFormat(optarg);
+            if (trace_format == NULL) {
+                printf("%s: Unknown trace format %s\n", argv[0], optarg);
+                printUsage(argv);
+                exit(1);
+            }
+            break;
+        case 'p':
+            traceSetThreads(atoi(optarg));
+            break;
+        case 'j':
+            threads = atoi(optarg);
+            break;
+        case 'W':
+            sweep_spec = optarg;
+            break;
+        case 'O':
+            results_format = optarg;
+            break;
+        case 'o':
+            results_file = optarg;
+            break;
         case 'v':
             verbosity = 1;
             break;
+        case 'P':
+            use_pipeline = 1;
+            break;
+        case 'H':
+            use_huge_pages = 1;
+            break;
+        case 'R':
+            reorder = 1;
+            break;
+        case 'D':
+            stack_distances = 1;
+            break;
+        case 'A':
+            all_assoc = atoi(optarg);
+            break;
+        case 'S':
+            all_assoc_smax = atoi(optarg);
+            break;
         case 'h':
             printUsage(argv);
             exit(0);
@@ -250,12 +545,76 @@ int main(int argc, char* argv[])
     }
 
     /* Make sure that all required command line args were specified */
-    if (s == 0 || E == 0 || b == 0 || trace_file == NULL) {
+    int have_cache = s_given && s >= 0 && E != 0;
+    if (stack_distances) {
+        have_cache = 1;     /* sizes them all */
+    } else if (sweep_spec != NULL) {
+        have_cache = 1;     /* checked against the grid */
+        s = s_given ? s : -1;
+    } else if (all_assoc > 0) {
+        have_cache = (s_given && s >= 0) || all_assoc_smax >= 0;
+    }
+    if (!have_cache || (b == 0 && sweep_spec == NULL) || trace_file == NULL) {
         printf("%s: Missing required command line argument\n", argv[0]);
         printUsage(argv);
         exit(1);
     }
 
+    if (results_format != NULL || results_file != NULL) {
+        if (results_format == NULL) {
+            results_format = "json";
+        }
+        openResults();
+    }
+
+    /* Sweep mode: a grid of caches over the same trace */
+    if (sweep_spec != NULL) {
+        runSweep();
+        if (results != NULL) {
+            closeResults();
+        }
+        return 0;
+    }
+
+    /* Stack distance mode: no cache to simulate, every size at once */
+    if (stack_distances) {
+        stack_dist = stackdistCreate(b);
+        if (stack_dist == NULL) {
+            printf("Stack distances: %s\n", strerror(errno));
+            exit(1);
+        }
+        replay = replayStackDist;
+        double start = now();
+        replayTrace(trace_file);
+        printMissCurve(now() - start);
+        stackdistFree(stack_dist);
+        if (results != NULL) {
+            closeResults();
+        }
+        return 0;
+    }
+
+    /* All-associativity mode: every E up to all_assoc at once */
+    if (all_assoc > 0) {
+        int smin = all_assoc_smax >= 0 ? 0 : s;
+        int smax = all_assoc_smax >= 0 ? all_assoc_smax : s;
+
+        all_assoc_sim = allassocCreate(smin, smax, all_assoc, b);
+        if (all_assoc_sim == NULL) {
+            printf("All-associativity simulation: %s\n", strerror(errno));
+            exit(1);
+        }
+        replay = replayAllAssoc;
+        double start = now();
+        replayTrace(trace_file);
+        printAllAssoc(smin, smax, now() - start);
+        allassocFree(all_assoc_sim);
+        if (results != NULL) {
+            closeResults();
+        }
+        return 0;
+    }
+
     /* Initialize cache */
     initCache();
 
@@ -264,11 +623,25 @@ int main(int argc, char* argv[])
 #endif
  
     /* Replay the memory access trace */
+    double start = now();
     replayTrace(trace_file);
 
     /* Free allocated memory */
+    collectStats();
+    double elapsed = now() - start;
     freeCache();
 
+    /* Rows of results replace the summary; they do not truncate counts */
+    if (results != NULL) {
+        writeResult(s, E, b, &totals, 0, elapsed, 0);
+        closeResults();
+        return 0;
+    }
+    if (totals.hits > INT_MAX || totals.misses > INT_MAX || totals.evictions > INT_MAX) {
+        fprintf(stderr, "%s: counts past %d are truncated in the summary; "
+                "--results has them all\n", argv[0], INT_MAX);
+    }
+
     /* Output the hit and miss statistics for the autograder */
     printSummary(hit_count, miss_count, eviction_count);
     return 0;
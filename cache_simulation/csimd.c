@@ -0,0 +1,927 @@
+/*
+ * csimd.c - Cache simulation daemon
+ *
+ * csimd runs simulations for clients of a Unix domain socket, so a
+ * script that runs thousands of them pays for starting a process and
+ * decoding a trace once instead of every time. A client writes jobs,
+ * one JSON object per line:
+ *
+ *   {"id": 7, "trace": "traces/long.trace", "s": 5, "E": 1, "b": 5}
+ *
+ * and reads one line back per job, in the order the jobs finish:
+ *
+ *   {"id": 7, "hits": 265189, "misses": 21775, "evictions": 21743,
+ *    "records": 267988, "trace_cached": true}
+ *
+ * or {"id": 7, "error": "..."}. Besides trace, s, E and b, a job may
+ * give "format" (a trace format name, detected if absent), "reorder"
+ * and "huge_pages" (booleans, csim's -R and -H), "priority" (an
+ * integer: higher runs first, equal ones in the order they came) and
+ * "id", a number or string echoed back as it was given.
+ *
+ * Decoded traces stay in memory, the least recently used dropped first
+ * once together they take more than the budget (-m). A trace whose file
+ * changed is decoded again. Jobs run on a pool of worker threads (-j).
+ */
+#define _DEFAULT_SOURCE /* realpath */
+
+#include <getopt.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <pthread.h>
+#include <signal.h>
+#include <time.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+#include "libcsim.h"
+#include "trace.h"
+
+/* Longest job line, and longest id echoed back */
+#define CSIMD_MAX_LINE (64 * 1024)
+#define CSIMD_MAX_ID 256
+
+/* Type: A decoded trace
+ * Listed entries are in traces.head; one dropped while in use is
+ * unlisted, and freed by its last user.
+ */
+typedef struct trace_entry {
+    struct trace_entry* next;
+    char* path;                     /* canonical, from realpath() */
+    const trace_format_t* format;   /* NULL: detected */
+    struct stat st;                 /* the file when it was decoded */
+    trace_rec_t* recs;
+    size_t nrecs;
+    int refs;
+    int loading;        /* being decoded; wait for loaded */
+    int listed;
+    int err;            /* decoding failed with this errno */
+    unsigned long long used;    /* traces.clock at the last use */
+} trace_entry_t;
+
+/* The decoded traces */
+static struct {
+    pthread_mutex_t lock;
+    pthread_cond_t loaded;
+    trace_entry_t* head;
+    size_t bytes;       /* records of the listed entries */
+    size_t budget;
+    unsigned long long clock;
+} traces = { PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER, NULL, 0, 0, 0 };
+
+/* Type: A client connection, shared by its reader and its jobs */
+typedef struct conn {
+    int fd;
+    int refs;
+    pthread_mutex_t lock;   /* one reply written at a time */
+} conn_t;
+
+/* Type: A job of a connection */
+typedef struct job {
+    conn_t* conn;
+    char id[CSIMD_MAX_ID + 1];      /* JSON text, "null" if none */
+    char* trace;
+    const trace_format_t* format;
+    int s, E, b;
+    int flags;
+    long long priority;
+    unsigned long long seq;         /* arrival order */
+} job_t;
+
+/* Jobs waiting for a worker, a binary heap by priority */
+static struct {
+    pthread_mutex_t lock;
+    pthread_cond_t ready;
+    job_t** heap;
+    size_t len, cap;
+    unsigned long long seq;
+} queue = { PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER, NULL, 0, 0, 0 };
+
+/* The socket, unlinked on the way out */
+static char* socket_path;
+
+/* now - seconds on a monotonic clock */
+static double now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* sameFile - whether st still describes the file decoded into entry */
+static int sameFile(const trace_entry_t* entry, const struct stat* st)
+{
+    return entry->st.st_dev == st->st_dev && entry->st.st_ino == st->st_ino &&
+           entry->st.st_size == st->st_size &&
+           entry->st.st_mtim.tv_sec == st->st_mtim.tv_sec &&
+           entry->st.st_mtim.tv_nsec == st->st_mtim.tv_nsec;
+}
+
+/* freeEntry - free a decoded trace */
+static void freeEntry(trace_entry_t* entry)
+{
+    free(entry->recs);
+    free(entry->path);
+    free(entry);
+}
+
+/* unlistEntry - take an entry off the list; traces.lock held */
+static void unlistEntry(trace_entry_t* entry)
+{
+    trace_entry_t** p = &traces.head;
+
+    while (*p != entry)
+        p = &(*p)->next;
+    *p = entry->next;
+    entry->listed = 0;
+    traces.bytes -= entry->nrecs * sizeof(trace_rec_t);
+}
+
+/* trimTraces - drop unused traces, least recently used first, until the
+ * rest fit the budget; traces.lock held
+ */
+static void trimTraces(void)
+{
+    while (traces.bytes > traces.budget) {
+        trace_entry_t* victim = NULL;
+
+        for (trace_entry_t* e = traces.head; e != NULL; e = e->next) {
+            if (e->refs == 0 && (victim == NULL || e->used < victim->used))
+                victim = e;
+        }
+        if (victim == NULL)
+            return;
+        unlistEntry(victim);
+        fprintf(stderr, "csimd: dropped %s\n", victim->path);
+        freeEntry(victim);
+    }
+}
+
+/* releaseTrace - done with a trace from acquireTrace() */
+static void releaseTrace(trace_entry_t* entry)
+{
+    pthread_mutex_lock(&traces.lock);
+    if (--entry->refs == 0 && !entry->listed)
+        freeEntry(entry);
+    else
+        trimTraces();
+    pthread_mutex_unlock(&traces.lock);
+}
+
+/* loadTrace - decode a whole trace into entry */
+static int loadTrace(trace_entry_t* entry)
+{
+    double start = now();
+
+    if (traceLoad(entry->path, entry->format, &entry->recs, &entry->nrecs) != 0)
+        return -1;
+    fprintf(stderr, "csimd: loaded %s: %zu records in %.3f s\n",
+            entry->path, entry->nrecs, now() - start);
+    return 0;
+}
+
+/*
+ * acquireTrace - Get the records of a trace, decoding it unless it is in
+ *                memory already, and set *cached accordingly. Returns
+ *                NULL and sets errno on failure.
+ */
+static trace_entry_t* acquireTrace(const char* fn, const trace_format_t* format, int* cached)
+{
+    trace_entry_t* entry;
+    struct stat st;
+    char* path = realpath(fn, NULL);
+
+    if (path == NULL)
+        return NULL;
+    if (stat(path, &st) != 0) {
+        int err = errno;
+
+        free(path);
+        errno = err;
+        return NULL;
+    }
+    if (!S_ISREG(st.st_mode)) {
+        /* Pipes and devices cannot be kept */
+        free(path);
+        errno = EINVAL;
+        return NULL;
+    }
+
+    pthread_mutex_lock(&traces.lock);
+    for (entry = traces.head; entry != NULL; entry = entry->next) {
+        if (entry->format == format && strcmp(entry->path, path) == 0)
+            break;
+    }
+    if (entry != NULL && !entry->loading && !sameFile(entry, &st)) {
+        fprintf(stderr, "csimd: %s changed\n", entry->path);
+        unlistEntry(entry);
+        if (entry->refs == 0)
+            freeEntry(entry);
+        entry = NULL;
+    }
+    if (entry != NULL) {
+        free(path);
+        entry->refs++;
+        while (entry->loading)
+            pthread_cond_wait(&traces.loaded, &traces.lock);
+        if (entry->err != 0) {
+            int err = entry->err;
+
+            if (--entry->refs == 0)
+                freeEntry(entry);
+            pthread_mutex_unlock(&traces.lock);
+            errno = err;
+            return NULL;
+        }
+        entry->used = ++traces.clock;
+        pthread_mutex_unlock(&traces.lock);
+        *cached = 1;
+        return entry;
+    }
+
+    entry = (trace_entry_t*)calloc(1, sizeof(trace_entry_t));
+    if (entry == NULL) {
+        pthread_mutex_unlock(&traces.lock);
+        free(path);
+        return NULL;
+    }
+    entry->path = path;
+    entry->format = format;
+    entry->st = st;
+    entry->refs = 1;
+    entry->loading = 1;
+    entry->listed = 1;
+    entry->next = traces.head;
+    traces.head = entry;
+    pthread_mutex_unlock(&traces.lock);
+
+    /* Decode without the lock; others wanting the trace wait for it */
+    int err = loadTrace(entry) == 0 ? 0 : errno;
+
+    pthread_mutex_lock(&traces.lock);
+    entry->loading = 0;
+    entry->err = err;
+    entry->used = ++traces.clock;
+    traces.bytes += entry->nrecs * sizeof(trace_rec_t);
+    if (err != 0) {
+        unlistEntry(entry);
+        if (--entry->refs == 0)
+            freeEntry(entry);
+    }
+    pthread_cond_broadcast(&traces.loaded);
+    trimTraces();
+    pthread_mutex_unlock(&traces.lock);
+    if (err != 0) {
+        errno = err;
+        return NULL;
+    }
+    *cached = 0;
+    return entry;
+}
+
+/* releaseConn - drop a reference to a connection, closing it with the last */
+static void releaseConn(conn_t* conn)
+{
+    if (__atomic_sub_fetch(&conn->refs, 1, __ATOMIC_ACQ_REL) > 0)
+        return;
+    close(conn->fd);
+    pthread_mutex_destroy(&conn->lock);
+    free(conn);
+}
+
+/* jsonQuote - write s as a JSON string into out of the given size */
+static void jsonQuote(char* out, size_t size, const char* s)
+{
+    size_t len = 0;
+
+    out[len++] = '"';
+    for (; *s != '\0' && len + 8 < size; s++) {
+        unsigned char c = (unsigned char)*s;
+
+        if (c == '"' || c == '\\') {
+            out[len++] = '\\';
+            out[len++] = c;
+        } else if (c < 0x20) {
+            len += snprintf(out + len, size - len, "\\u%04x", c);
+        } else {
+            out[len++] = c;
+        }
+    }
+    out[len++] = '"';
+    out[len] = '\0';
+}
+
+/* reply - send a job's reply line, whose fields after the id are body;
+ * a client that went away is not an error
+ */
+static void reply(job_t* job, const char* body)
+{
+    char line[CSIMD_MAX_ID + 1024];
+    int len = snprintf(line, sizeof(line), "{\"id\": %s, %s}\n", job->id, body);
+
+    if (len >= (int)sizeof(line))
+        len = sizeof(line) - 1;
+    pthread_mutex_lock(&job->conn->lock);
+    for (int off = 0; off < len; ) {
+        ssize_t n = send(job->conn->fd, line + off, len - off, MSG_NOSIGNAL);
+
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            break;
+        off += n;
+    }
+    pthread_mutex_unlock(&job->conn->lock);
+}
+
+/* replyError - send a job's error message, prefixed with what failed */
+static void replyError(job_t* job, const char* what, const char* msg)
+{
+    char text[768], body[900];
+
+    if (what != NULL)
+        snprintf(text, sizeof(text), "%s: %s", what, msg);
+    else
+        snprintf(text, sizeof(text), "%s", msg);
+    strcpy(body, "\"error\": ");
+    jsonQuote(body + strlen(body), sizeof(body) - strlen(body), text);
+    reply(job, body);
+}
+
+/* runJob - simulate a job and reply with its counts */
+static void runJob(job_t* job)
+{
+    csim_config_t config = { job->s, job->E, job->b, job->flags, 1 };
+    trace_entry_t* entry;
+    csim_t* sim;
+    cache_stats_t stats;
+    char body[256];
+    int cached = 0;
+
+    entry = acquireTrace(job->trace, job->format, &cached);
+    if (entry == NULL) {
+        replyError(job, job->trace, strerror(errno));
+        return;
+    }
+    sim = csimCreate(&config);
+    if (sim == NULL) {
+        snprintf(body, sizeof(body), "s:%d E:%d b:%d", job->s, job->E, job->b);
+        replyError(job, body, strerror(errno));
+        releaseTrace(entry);
+        return;
+    }
+    csimAccessBatch(sim, entry->recs, entry->nrecs);
+    csimStats(sim, &stats);
+    csimFree(sim);
+    snprintf(body, sizeof(body), "\"hits\": %llu, \"misses\": %llu, \"evictions\": %llu, "
+             "\"records\": %zu, \"trace_cached\": %s", stats.hits, stats.misses,
+             stats.evictions, entry->nrecs, cached ? "true" : "false");
+    releaseTrace(entry);
+    reply(job, body);
+}
+
+/* freeJob - free a job and its reference to the connection */
+static void freeJob(job_t* job)
+{
+    releaseConn(job->conn);
+    free(job->trace);
+    free(job);
+}
+
+/* jobBefore - whether job a runs before job b */
+static int jobBefore(const job_t* a, const job_t* b)
+{
+    return a->priority != b->priority ? a->priority > b->priority : a->seq < b->seq;
+}
+
+/* pushJob - queue a job for the workers */
+static int pushJob(job_t* job)
+{
+    pthread_mutex_lock(&queue.lock);
+    if (queue.len == queue.cap) {
+        size_t cap = queue.cap ? 2 * queue.cap : 64;
+        job_t** grown = (job_t**)realloc(queue.heap, cap * sizeof(job_t*));
+
+        if (grown == NULL) {
+            pthread_mutex_unlock(&queue.lock);
+            errno = ENOMEM;
+            return -1;
+        }
+        queue.heap = grown;
+        queue.cap = cap;
+    }
+    job->seq = queue.seq++;
+    size_t i = queue.len++;
+    while (i > 0 && jobBefore(job, queue.heap[(i - 1) / 2])) {
+        queue.heap[i] = queue.heap[(i - 1) / 2];
+        i = (i - 1) / 2;
+    }
+    queue.heap[i] = job;
+    pthread_cond_signal(&queue.ready);
+    pthread_mutex_unlock(&queue.lock);
+    return 0;
+}
+
+/* popJob - take the job that runs next, waiting for one */
+static job_t* popJob(void)
+{
+    job_t* top;
+
+    pthread_mutex_lock(&queue.lock);
+    while (queue.len == 0)
+        pthread_cond_wait(&queue.ready, &queue.lock);
+    top = queue.heap[0];
+    job_t* last = queue.heap[--queue.len];
+    size_t i = 0, child;
+    while ((child = 2 * i + 1) < queue.len) {
+        if (child + 1 < queue.len && jobBefore(queue.heap[child + 1], queue.heap[child]))
+            child++;
+        if (!jobBefore(queue.heap[child], last))
+            break;
+        queue.heap[i] = queue.heap[child];
+        i = child;
+    }
+    queue.heap[i] = last;
+    pthread_mutex_unlock(&queue.lock);
+    return top;
+}
+
+/* workerMain - run jobs, most urgent first, forever */
+static void* workerMain(void* arg)
+{
+    (void)arg;
+    for (;;) {
+        job_t* job = popJob();
+
+        runJob(job);
+        freeJob(job);
+    }
+    return NULL;
+}
+
+/* jsonSpace - skip white space */
+static const char* jsonSpace(const char* p)
+{
+    while (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n')
+        p++;
+    return p;
+}
+
+/* jsonHex - read the four hex digits of a \u escape */
+static int jsonHex(const char* p, unsigned long* cp)
+{
+    *cp = 0;
+    for (int i = 0; i < 4; i++) {
+        char c = p[i];
+
+        if (c >= '0' && c <= '9')
+            *cp = *cp * 16 + (c - '0');
+        else if (c >= 'a' && c <= 'f')
+            *cp = *cp * 16 + (c - 'a' + 10);
+        else if (c >= 'A' && c <= 'F')
+            *cp = *cp * 16 + (c - 'A' + 10);
+        else
+            return -1;
+    }
+    return 0;
+}
+
+/*
+ * jsonString - Decode the JSON string starting at the quote at p into a
+ *              new string and set *end past it. Returns NULL if it is
+ *              malformed or holds a NUL.
+ */
+static char* jsonString(const char* p, const char** end)
+{
+    /* Decoding never makes a string longer */
+    char* out = (char*)malloc(strlen(p) + 1);
+    size_t len = 0;
+    unsigned long cp, low;
+
+    if (out == NULL)
+        return NULL;
+    for (p++; *p != '"'; ) {
+        if ((unsigned char)*p < 0x20)
+            goto bad;
+        if (*p != '\\') {
+            out[len++] = *p++;
+            continue;
+        }
+        p += 2;
+        switch (p[-1]) {
+        case '"':  out[len++] = '"';  break;
+        case '\\': out[len++] = '\\'; break;
+        case '/':  out[len++] = '/';  break;
+        case 'b':  out[len++] = '\b'; break;
+        case 'f':  out[len++] = '\f'; break;
+        case 'n':  out[len++] = '\n'; break;
+        case 'r':  out[len++] = '\r'; break;
+        case 't':  out[len++] = '\t'; break;
+        case 'u':
+            if (jsonHex(p, &cp) != 0 || cp == 0)
+                goto bad;
+            p += 4;
+            if (cp >= 0xd800 && cp < 0xdc00 && p[0] == '\\' && p[1] == 'u' &&
+                jsonHex(p + 2, &low) == 0 && low >= 0xdc00 && low < 0xe000) {
+                cp = 0x10000 + ((cp - 0xd800) << 10) + (low - 0xdc00);
+                p += 6;
+            }
+            /* UTF-8 */
+            if (cp < 0x80) {
+                out[len++] = (char)cp;
+            } else if (cp < 0x800) {
+                out[len++] = (char)(0xc0 | (cp >> 6));
+                out[len++] = (char)(0x80 | (cp & 0x3f));
+            } else if (cp < 0x10000) {
+                out[len++] = (char)(0xe0 | (cp >> 12));
+                out[len++] = (char)(0x80 | ((cp >> 6) & 0x3f));
+                out[len++] = (char)(0x80 | (cp & 0x3f));
+            } else {
+                out[len++] = (char)(0xf0 | (cp >> 18));
+                out[len++] = (char)(0x80 | ((cp >> 12) & 0x3f));
+                out[len++] = (char)(0x80 | ((cp >> 6) & 0x3f));
+                out[len++] = (char)(0x80 | (cp & 0x3f));
+            }
+            break;
+        default:
+            goto bad;
+        }
+    }
+    out[len] = '\0';
+    *end = p + 1;
+    return out;
+bad:
+    free(out);
+    return NULL;
+}
+
+/* jsonInt - read a JSON number that must be an integer */
+static int jsonInt(const char* p, const char** end, long long* val)
+{
+    char* q;
+
+    if (*p != '-' && (*p < '0' || *p > '9'))
+        return -1;
+    errno = 0;
+    *val = strtoll(p, &q, 10);
+    if (errno != 0 || *q == '.' || *q == 'e' || *q == 'E')
+        return -1;
+    *end = q;
+    return 0;
+}
+
+/*
+ * parseJob - Fill in a job from its JSON line. Returns -1 with a message
+ *            in msg if the line is not a valid job; job->id is set if
+ *            the line got that far.
+ */
+static int parseJob(const char* line, job_t* job, char* msg, size_t size)
+{
+    const char* p = jsonSpace(line);
+    int given_s = 0, given_E = 0, given_b = 0;
+
+    if (*p != '{') {
+        snprintf(msg, size, "expected a JSON object");
+        return -1;
+    }
+    p = jsonSpace(p + 1);
+    while (*p != '}') {
+        const char* start;
+        char* key;
+        long long val;
+        int bad = 0;
+
+        if (*p != '"' || (key = jsonString(p, &p)) == NULL) {
+            snprintf(msg, size, "expected a key");
+            return -1;
+        }
+        p = jsonSpace(p);
+        if (*p != ':') {
+            snprintf(msg, size, "expected : after %s", key);
+            free(key);
+            return -1;
+        }
+        p = start = jsonSpace(p + 1);
+
+        if (strcmp(key, "trace") == 0 || strcmp(key, "format") == 0) {
+            char* str = *p == '"' ? jsonString(p, &p) : NULL;
+
+            if (str == NULL) {
+                bad = 1;
+            } else if (key[0] == 't') {
+                free(job->trace);
+                job->trace = str;
+            } else {
+                job->format = traceFindFormat(str);
+                if (job->format == NULL) {
+                    snprintf(msg, size, "unknown trace format %s", str);
+                    free(str);
+                    free(key);
+                    return -1;
+                }
+                free(str);
+            }
+        } else if (strcmp(key, "s") == 0 || strcmp(key, "E") == 0 || strcmp(key, "b") == 0) {
+            bad = jsonInt(p, &p, &val) != 0 || val < 0 || val > INT_MAX;
+            if (!bad && key[0] == 's') {
+                job->s = (int)val;
+                given_s = 1;
+            } else if (!bad && key[0] == 'E') {
+                job->E = (int)val;
+                given_E = 1;
+            } else if (!bad) {
+                job->b = (int)val;
+                given_b = 1;
+            }
+        } else if (strcmp(key, "priority") == 0) {
+            bad = jsonInt(p, &p, &job->priority) != 0;
+        } else if (strcmp(key, "reorder") == 0 || strcmp(key, "huge_pages") == 0) {
+            int flag = key[0] == 'r' ? CACHE_REORDER : CACHE_HUGE_PAGES;
+
+            if (strncmp(p, "true", 4) == 0) {
+                job->flags |= flag;
+                p += 4;
+            } else if (strncmp(p, "false", 5) == 0) {
+                job->flags &= ~flag;
+                p += 5;
+            } else {
+                bad = 1;
+            }
+        } else if (strcmp(key, "id") == 0) {
+            char* str = NULL;
+
+            /* Echoed back verbatim, so it only needs to be well formed */
+            if (*p == '"')
+                bad = (str = jsonString(p, &p)) == NULL;
+            else
+                bad = jsonInt(p, &p, &val) != 0;
+            free(str);
+            if (!bad && p - start > CSIMD_MAX_ID) {
+                snprintf(msg, size, "id longer than %d characters", CSIMD_MAX_ID);
+                free(key);
+                return -1;
+            }
+            if (!bad) {
+                memcpy(job->id, start, p - start);
+                job->id[p - start] = '\0';
+            }
+        } else {
+            snprintf(msg, size, "unknown key %s", key);
+            free(key);
+            return -1;
+        }
+        if (bad) {
+            snprintf(msg, size, "bad value for %s", key);
+            free(key);
+            return -1;
+        }
+        free(key);
+
+        p = jsonSpace(p);
+        if (*p == ',')
+            p = jsonSpace(p + 1);
+        else if (*p != '}') {
+            snprintf(msg, size, "expected , or }");
+            return -1;
+        }
+    }
+    if (*jsonSpace(p + 1) != '\0') {
+        snprintf(msg, size, "trailing characters after the object");
+        return -1;
+    }
+    if (job->trace == NULL || !given_s || !given_E || !given_b) {
+        snprintf(msg, size, "a job needs trace, s, E and b");
+        return -1;
+    }
+    return 0;
+}
+
+/* connMain - read a connection's jobs and queue them. Lines are read
+ * into a fixed buffer, so a client cannot make the daemon hold more
+ * than CSIMD_MAX_LINE bytes of one; the connection is dropped after a
+ * longer one, whose rest would be read as more jobs.
+ */
+static void* connMain(void* arg)
+{
+    conn_t* conn = (conn_t*)arg;
+    int fd = dup(conn->fd);
+    FILE* in = fd < 0 ? NULL : fdopen(fd, "r");
+    /* One byte more than a line may have, to tell when it is longer */
+    char* line = (char*)malloc(CSIMD_MAX_LINE + 2);
+    size_t len;
+    char msg[256];
+
+    if (in == NULL || line == NULL) {
+        if (in != NULL)
+            fclose(in);
+        else if (fd >= 0)
+            close(fd);
+        free(line);
+        releaseConn(conn);
+        return NULL;
+    }
+    while (fgets(line, CSIMD_MAX_LINE + 2, in) != NULL) {
+        job_t* job;
+
+        len = strlen(line);
+
+        if (*jsonSpace(line) == '\0')
+            continue;
+        job = (job_t*)calloc(1, sizeof(job_t));
+        if (job == NULL)
+            break;
+        job->conn = conn;
+        strcpy(job->id, "null");
+        __atomic_add_fetch(&conn->refs, 1, __ATOMIC_RELAXED);
+
+        if (len > CSIMD_MAX_LINE) {
+            snprintf(msg, sizeof(msg), "line longer than %d bytes", CSIMD_MAX_LINE);
+            replyError(job, NULL, msg);
+            freeJob(job);
+            break;
+        } else if (parseJob(line, job, msg, sizeof(msg)) != 0) {
+            replyError(job, NULL, msg);
+            freeJob(job);
+        } else if (pushJob(job) != 0) {
+            replyError(job, NULL, strerror(errno));
+            freeJob(job);
+        }
+    }
+    free(line);
+    fclose(in);
+    releaseConn(conn);
+    return NULL;
+}
+
+/* stop - signal handler: remove the socket and exit */
+static void stop(int sig)
+{
+    (void)sig;
+    unlink(socket_path);
+    _exit(0);
+}
+
+/* listenOn - create, bind and listen on the socket at path, replacing a
+ * stale socket nobody listens on. Returns -1 and sets errno on failure.
+ */
+static int listenOn(const char* path)
+{
+    struct sockaddr_un addr;
+    struct stat st;
+    int fd;
+
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path);
+
+    fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0)
+        return -1;
+    if (lstat(path, &st) == 0 && S_ISSOCK(st.st_mode)) {
+        if (connect(fd, (struct sockaddr*)&addr, sizeof(addr)) == 0) {
+            close(fd);
+            errno = EADDRINUSE;
+            return -1;
+        }
+        unlink(path);
+    }
+    if (bind(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0 || listen(fd, SOMAXCONN) != 0) {
+        int err = errno;
+
+        close(fd);
+        errno = err;
+        return -1;
+    }
+    return fd;
+}
+
+/* printUsage - Print usage info */
+void printUsage(char* argv[])
+{
+    printf("Usage: %s [-h] [-j <num>] [-m <MiB>] [-p <num>] -S <socket>\n", argv[0]);
+    printf("Options:\n");
+    printf("  -h         Print this help message.\n");
+    printf("  -S <file>  Unix domain socket to listen on.\n");
+    printf("  -j <num>   Simulation worker threads (default: one per CPU).\n");
+    printf("  -m <MiB>   Memory for decoded traces (default: 1024).\n");
+    printf("  -p <num>   Trace parser threads (default: one per CPU).\n");
+    printf("\nJobs are JSON objects, one per line:\n");
+    printf("  {\"id\": 1, \"trace\": \"traces/yi.trace\", \"s\": 4, \"E\": 1, \"b\": 4}\n");
+    printf("Optional keys: format, reorder, huge_pages, priority.\n");
+    printf("\nExamples:\n");
+    printf("  linux>  %s -S /tmp/csimd.sock &\n", argv[0]);
+    printf("  linux>  echo '{\"trace\": \"traces/yi.trace\", \"s\": 4, \"E\": 1, \"b\": 4}' | "
+           "nc -U -N /tmp/csimd.sock\n");
+}
+
+/* main - Main routine */
+int main(int argc, char* argv[])
+{
+    struct sigaction sa;
+    long workers = 0, budget = 1024;
+    int c, fd;
+
+    while ((c = getopt(argc, argv, "S:j:m:p:h")) != -1) {
+        switch (c) {
+        case 'S':
+            socket_path = optarg;
+            break;
+        case 'j':
+            workers = atol(optarg);
+            break;
+        case 'm':
+            budget = atol(optarg);
+            break;
+        case 'p':
+            traceSetThreads(atoi(optarg));
+            break;
+        case 'h':
+            printUsage(argv);
+            exit(0);
+        default:
+            printUsage(argv);
+            exit(1);
+        }
+    }
+    if (socket_path == NULL) {
+        printf("%s: Missing required command line argument\n", argv[0]);
+        printUsage(argv);
+        exit(1);
+    }
+    if (budget < 0 || (unsigned long)budget > ((size_t)-1 >> 20)) {
+        printf("%s: Invalid trace memory budget %ld\n", argv[0], budget);
+        exit(1);
+    }
+    traces.budget = (size_t)budget << 20;
+    if (workers <= 0)
+        workers = sysconf(_SC_NPROCESSORS_ONLN);
+    if (workers <= 0)
+        workers = 1;
+
+    fd = listenOn(socket_path);
+    if (fd < 0) {
+        printf("%s: %s\n", socket_path, strerror(errno));
+        exit(1);
+    }
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = stop;
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+    signal(SIGPIPE, SIG_IGN);
+
+    for (long i = 0; i < workers; i++) {
+        pthread_t tid;
+
+        if (pthread_create(&tid, NULL, workerMain, NULL) != 0) {
+            printf("%s: Cannot start worker threads\n", argv[0]);
+            unlink(socket_path);
+            exit(1);
+        }
+        pthread_detach(tid);
+    }
+    fprintf(stderr, "csimd: listening on %s, %ld workers, %ld MiB for traces\n",
+            socket_path, workers, budget);
+
+    for (;;) {
+        pthread_t tid;
+        conn_t* conn;
+        int client = accept(fd, NULL, NULL);
+
+        if (client < 0) {
+            if (errno == EINTR || errno == ECONNABORTED || errno == EMFILE ||
+                errno == ENFILE || errno == ENOMEM) {
+                /* Transient: let clients finish before taking more */
+                if (errno != EINTR && errno != ECONNABORTED)
+                    sleep(1);
+                continue;
+            }
+            printf("%s: %s\n", socket_path, strerror(errno));
+            unlink(socket_path);
+            exit(1);
+        }
+        conn = (conn_t*)calloc(1, sizeof(conn_t));
+        if (conn == NULL) {
+            close(client);
+            continue;
+        }
+        conn->fd = client;
+        conn->refs = 1;
+        pthread_mutex_init(&conn->lock, NULL);
+        if (pthread_create(&tid, NULL, connMain, conn) != 0) {
+            releaseConn(conn);
+            continue;
+        }
+        pthread_detach(tid);
+    }
+    return 0;
+}
@@ -0,0 +1,531 @@
+/*
+ * csimmodule.c - Python bindings for the cache simulator
+ *
+ *   import csim
+ *   trace = csim.load_trace("traces/long.trace")
+ *   csim.simulate(trace, 5, 1, 5)    # csim.Stats(hits=..., misses=..., evictions=...)
+ *
+ * simulate() takes a trace path, a Trace from load_trace() (decoded
+ * once, replayed by any number of simulations) or a buffer of 64-bit
+ * addresses, such as a numpy uint64 array, with an optional buffer of
+ * op bytes (b"L", b"S" or b"M"; loads if absent). A Cache keeps its
+ * state between calls and returns the counts of each call, and can
+ * report which accesses hit. Decoding and simulation run without the
+ * GIL, so simulations on different threads run in parallel; a Cache
+ * used from several threads runs one call at a time.
+ *
+ * Built by "make python" as csim$(python3-config --extension-suffix).
+ */
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+#include <pythread.h>
+
+#include <errno.h>
+#include <string.h>
+
+#include "libcsim.h"
+
+/* Type: Trace, the records of a decoded trace */
+typedef struct {
+    PyObject_HEAD
+    trace_rec_t* recs;
+    size_t nrecs;
+} trace_object_t;
+
+/* Type: Cache, a simulation and the lock that serializes its calls */
+typedef struct {
+    PyObject_HEAD
+    csim_t* sim;
+    PyThread_type_lock lock;
+} cache_object_t;
+
+static PyTypeObject TraceType;
+static PyTypeObject CacheType;
+static PyTypeObject StatsType;
+
+static PyStructSequence_Field stats_fields[] = {
+    { "hits", "accesses that hit" },
+    { "misses", "accesses that missed" },
+    { "evictions", "misses that evicted a valid line" },
+    { NULL, NULL },
+};
+
+static PyStructSequence_Desc stats_desc = {
+    "csim.Stats",
+    "Hits, misses and evictions of a simulation",
+    stats_fields,
+    3,
+};
+
+/* newStats - a csim.Stats of the counts */
+static PyObject* newStats(const cache_stats_t* stats)
+{
+    PyObject* obj = PyStructSequence_New(&StatsType);
+
+    if (obj == NULL)
+        return NULL;
+    PyStructSequence_SET_ITEM(obj, 0, PyLong_FromUnsignedLongLong(stats->hits));
+    PyStructSequence_SET_ITEM(obj, 1, PyLong_FromUnsignedLongLong(stats->misses));
+    PyStructSequence_SET_ITEM(obj, 2, PyLong_FromUnsignedLongLong(stats->evictions));
+    if (PyErr_Occurred()) {
+        Py_DECREF(obj);
+        return NULL;
+    }
+    return obj;
+}
+
+/* findFormat - the trace format named by a str, NULL for None (detect);
+ * returns -1 with an exception set for an unknown name
+ */
+static int findFormat(PyObject* name, const trace_format_t** format)
+{
+    const char* str;
+
+    *format = NULL;
+    if (name == NULL || name == Py_None)
+        return 0;
+    str = PyUnicode_AsUTF8(name);
+    if (str == NULL)
+        return -1;
+    *format = traceFindFormat(str);
+    if (*format == NULL) {
+        PyErr_Format(PyExc_ValueError, "unknown trace format %s", str);
+        return -1;
+    }
+    return 0;
+}
+
+/* loadTrace - decode the trace at a path without the GIL */
+static trace_object_t* loadTrace(PyObject* path, const trace_format_t* format)
+{
+    trace_object_t* trace;
+    PyObject* fn = NULL;
+    int err = 0;
+
+    if (!PyUnicode_FSConverter(path, &fn))
+        return NULL;
+    trace = PyObject_New(trace_object_t, &TraceType);
+    if (trace == NULL) {
+        Py_DECREF(fn);
+        return NULL;
+    }
+    trace->recs = NULL;
+    trace->nrecs = 0;
+    Py_BEGIN_ALLOW_THREADS
+    if (traceLoad(PyBytes_AS_STRING(fn), format, &trace->recs, &trace->nrecs) != 0)
+        err = errno;
+    Py_END_ALLOW_THREADS
+    if (err != 0) {
+        errno = err;
+        PyErr_SetFromErrnoWithFilenameObject(PyExc_OSError, path);
+        Py_DECREF(fn);
+        Py_DECREF(trace);
+        return NULL;
+    }
+    Py_DECREF(fn);
+    return trace;
+}
+
+static void traceDealloc(trace_object_t* self)
+{
+    free(self->recs);
+    PyObject_Free(self);
+}
+
+static Py_ssize_t traceLength(trace_object_t* self)
+{
+    return (Py_ssize_t)self->nrecs;
+}
+
+/* Type: The buffers of an access() or simulate() call */
+typedef struct {
+    Py_buffer addrs, ops, hit_bits;
+    int have_addrs, have_ops, have_hit_bits;
+} access_buffers_t;
+
+/* releaseBuffers - release whatever getBuffers() got */
+static void releaseBuffers(access_buffers_t* bufs)
+{
+    if (bufs->have_addrs)
+        PyBuffer_Release(&bufs->addrs);
+    if (bufs->have_ops)
+        PyBuffer_Release(&bufs->ops);
+    if (bufs->have_hit_bits)
+        PyBuffer_Release(&bufs->hit_bits);
+}
+
+/* getBuffers - get the address, op and hit bit buffers of a call, checking
+ * that the addresses are 64-bit integers, the ops bytes, one per address,
+ * and that the hit bits have room for one bit per address
+ */
+static int getBuffers(PyObject* addrs, PyObject* ops, PyObject* hit_bits,
+                      access_buffers_t* bufs)
+{
+    const char* fmt;
+    Py_ssize_t n;
+
+    memset(bufs, 0, sizeof(*bufs));
+    if (PyObject_GetBuffer(addrs, &bufs->addrs, PyBUF_C_CONTIGUOUS | PyBUF_FORMAT) != 0)
+        return -1;
+    bufs->have_addrs = 1;
+    fmt = bufs->addrs.format != NULL ? bufs->addrs.format : "B";
+    if (*fmt == '@' || *fmt == '=' || *fmt == '<')
+        fmt++;
+    if (bufs->addrs.itemsize != 8 || fmt[0] == '\0' || fmt[1] != '\0' ||
+        strchr("qQlLnN", fmt[0]) == NULL) {
+        PyErr_SetString(PyExc_TypeError, "addresses must be a buffer of 64-bit integers");
+        goto fail;
+    }
+    n = bufs->addrs.len / 8;
+
+    if (ops != NULL && ops != Py_None) {
+        if (PyObject_GetBuffer(ops, &bufs->ops, PyBUF_C_CONTIGUOUS) != 0)
+            goto fail;
+        bufs->have_ops = 1;
+        if (bufs->ops.len != n) {
+            PyErr_SetString(PyExc_ValueError, "ops must have one byte per address");
+            goto fail;
+        }
+    }
+    if (hit_bits != NULL && hit_bits != Py_None) {
+        if (PyObject_GetBuffer(hit_bits, &bufs->hit_bits, PyBUF_C_CONTIGUOUS | PyBUF_WRITABLE) != 0)
+            goto fail;
+        bufs->have_hit_bits = 1;
+        if (bufs->hit_bits.len < (n + 7) / 8) {
+            PyErr_SetString(PyExc_ValueError, "hit_bits must have a bit per address");
+            goto fail;
+        }
+    }
+    return 0;
+fail:
+    releaseBuffers(bufs);
+    return -1;
+}
+
+/* accessArrays - simulate the buffers of a call without the GIL, holding
+ * lock if there is one
+ */
+static PyObject* accessArrays(csim_t* sim, PyThread_type_lock lock, access_buffers_t* bufs)
+{
+    cache_stats_t delta;
+    int ret, err = 0;
+
+    Py_BEGIN_ALLOW_THREADS
+    if (lock != NULL)
+        PyThread_acquire_lock(lock, WAIT_LOCK);
+    ret = csimAccessArrays(sim, (const mem_addr_t*)bufs->addrs.buf,
+                           bufs->have_ops ? (const char*)bufs->ops.buf : NULL,
+                           (size_t)(bufs->addrs.len / 8), &delta,
+                           bufs->have_hit_bits ? (unsigned char*)bufs->hit_bits.buf : NULL);
+    if (ret != 0)
+        err = errno;
+    if (lock != NULL)
+        PyThread_release_lock(lock);
+    Py_END_ALLOW_THREADS
+    if (ret != 0) {
+        PyErr_SetString(PyExc_ValueError, err == EINVAL && bufs->have_hit_bits ?
+                        "ops must be b'L', b'S' or b'M', and hit_bits needs threads=1" :
+                        "ops must be b'L', b'S' or b'M'");
+        return NULL;
+    }
+    return newStats(&delta);
+}
+
+/* replayTrace - replay a decoded trace without the GIL, holding lock if
+ * there is one
+ */
+static PyObject* replayTrace(csim_t* sim, PyThread_type_lock lock, trace_object_t* trace)
+{
+    cache_stats_t before, after;
+
+    Py_BEGIN_ALLOW_THREADS
+    if (lock != NULL)
+        PyThread_acquire_lock(lock, WAIT_LOCK);
+    csimStats(sim, &before);
+    csimAccessBatch(sim, trace->recs, trace->nrecs);
+    csimStats(sim, &after);
+    if (lock != NULL)
+        PyThread_release_lock(lock);
+    Py_END_ALLOW_THREADS
+    after.hits -= before.hits;
+    after.misses -= before.misses;
+    after.evictions -= before.evictions;
+    return newStats(&after);
+}
+
+/* createSim - a simulation of the given geometry and options */
+static csim_t* createSim(int s, int E, int b, int reorder, int huge_pages, int threads)
+{
+    csim_config_t config = { s, E, b, 0, threads };
+    csim_t* sim;
+
+    config.flags = (reorder ? CACHE_REORDER : 0) | (huge_pages ? CACHE_HUGE_PAGES : 0);
+    Py_BEGIN_ALLOW_THREADS
+    sim = csimCreate(&config);
+    Py_END_ALLOW_THREADS
+    if (sim == NULL) {
+        if (errno == EINVAL)
+            PyErr_Format(PyExc_ValueError, "invalid cache geometry s=%d E=%d b=%d", s, E, b);
+        else
+            PyErr_SetFromErrno(PyExc_OSError);
+    }
+    return sim;
+}
+
+/* replayAny - replay a Trace, a trace path or an address buffer */
+static PyObject* replayAny(csim_t* sim, PyThread_type_lock lock, PyObject* trace,
+                           PyObject* ops, PyObject* hit_bits, PyObject* format_name)
+{
+    const trace_format_t* format;
+    access_buffers_t bufs;
+    PyObject* result;
+
+    if (PyObject_TypeCheck(trace, &TraceType) || PyUnicode_Check(trace) ||
+        PyBytes_Check(trace) || PyObject_HasAttrString(trace, "__fspath__")) {
+        if ((ops != NULL && ops != Py_None) || (hit_bits != NULL && hit_bits != Py_None)) {
+            PyErr_SetString(PyExc_TypeError, "ops and hit_bits go with address buffers");
+            return NULL;
+        }
+        if (PyObject_TypeCheck(trace, &TraceType))
+            return replayTrace(sim, lock, (trace_object_t*)trace);
+        if (findFormat(format_name, &format) != 0)
+            return NULL;
+        trace_object_t* loaded = loadTrace(trace, format);
+        if (loaded == NULL)
+            return NULL;
+        result = replayTrace(sim, lock, loaded);
+        Py_DECREF(loaded);
+        return result;
+    }
+    if (getBuffers(trace, ops, hit_bits, &bufs) != 0)
+        return NULL;
+    result = accessArrays(sim, lock, &bufs);
+    releaseBuffers(&bufs);
+    return result;
+}
+
+static int pyCacheInit(cache_object_t* self, PyObject* args, PyObject* kwds)
+{
+    static char* kwlist[] = { "s", "E", "b", "reorder", "huge_pages", "threads", NULL };
+    int s, E, b, reorder = 0, huge_pages = 0, threads = 1;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "iii|$ppi", kwlist, &s, &E, &b,
+                                     &reorder, &huge_pages, &threads))
+        return -1;
+    if (self->sim != NULL) {
+        PyErr_SetString(PyExc_RuntimeError, "Cache is already initialized");
+        return -1;
+    }
+    if (self->lock == NULL) {
+        self->lock = PyThread_allocate_lock();
+        if (self->lock == NULL) {
+            PyErr_NoMemory();
+            return -1;
+        }
+    }
+    self->sim = createSim(s, E, b, reorder, huge_pages, threads);
+    return self->sim == NULL ? -1 : 0;
+}
+
+static void pyCacheDealloc(cache_object_t* self)
+{
+    csimFree(self->sim);
+    if (self->lock != NULL)
+        PyThread_free_lock(self->lock);
+    Py_TYPE(self)->tp_free((PyObject*)self);
+}
+
+/* pyCacheReady - whether __init__ made a simulation */
+static int pyCacheReady(cache_object_t* self)
+{
+    if (self->sim == NULL) {
+        PyErr_SetString(PyExc_RuntimeError, "Cache is not initialized");
+        return 0;
+    }
+    return 1;
+}
+
+static PyObject* pyCacheReplay(cache_object_t* self, PyObject* args, PyObject* kwds)
+{
+    static char* kwlist[] = { "trace", "format", NULL };
+    PyObject* trace;
+    PyObject* format = NULL;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "O|$O", kwlist, &trace, &format))
+        return NULL;
+    if (!pyCacheReady(self))
+        return NULL;
+    if (!PyObject_TypeCheck(trace, &TraceType) && !PyUnicode_Check(trace) &&
+        !PyBytes_Check(trace) && !PyObject_HasAttrString(trace, "__fspath__")) {
+        PyErr_SetString(PyExc_TypeError, "replay() takes a Trace or a trace path");
+        return NULL;
+    }
+    return replayAny(self->sim, self->lock, trace, NULL, NULL, format);
+}
+
+static PyObject* pyCacheAccess(cache_object_t* self, PyObject* args, PyObject* kwds)
+{
+    static char* kwlist[] = { "addrs", "ops", "hit_bits", NULL };
+    PyObject *addrs, *ops = NULL, *hit_bits = NULL;
+    access_buffers_t bufs;
+    PyObject* result;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "O|OO", kwlist, &addrs, &ops, &hit_bits))
+        return NULL;
+    if (!pyCacheReady(self) || getBuffers(addrs, ops, hit_bits, &bufs) != 0)
+        return NULL;
+    result = accessArrays(self->sim, self->lock, &bufs);
+    releaseBuffers(&bufs);
+    return result;
+}
+
+static PyObject* pyCacheStats(cache_object_t* self, PyObject* unused)
+{
+    cache_stats_t stats;
+
+    (void)unused;
+    if (!pyCacheReady(self))
+        return NULL;
+    Py_BEGIN_ALLOW_THREADS
+    PyThread_acquire_lock(self->lock, WAIT_LOCK);
+    csimStats(self->sim, &stats);
+    PyThread_release_lock(self->lock);
+    Py_END_ALLOW_THREADS
+    return newStats(&stats);
+}
+
+static PyMethodDef cache_methods[] = {
+    { "replay", (PyCFunction)(void (*)(void))pyCacheReplay, METH_VARARGS | METH_KEYWORDS,
+      "replay(trace, *, format=None) -> Stats\n\n"
+      "Replay a Trace or the trace at a path; returns the counts of this replay." },
+    { "access", (PyCFunction)(void (*)(void))pyCacheAccess, METH_VARARGS | METH_KEYWORDS,
+      "access(addrs, ops=None, hit_bits=None) -> Stats\n\n"
+      "Simulate a buffer of 64-bit addresses with a byte buffer of ops (b'L',\n"
+      "b'S' or b'M'; loads if None). Bit i % 8 of byte i // 8 of the writable\n"
+      "buffer hit_bits is set if access i hit. Returns the counts of this call." },
+    { "stats", (PyCFunction)pyCacheStats, METH_NOARGS,
+      "stats() -> Stats\n\nThe counts of all accesses so far." },
+    { NULL, NULL, 0, NULL },
+};
+
+static PyObject* moduleLoadTrace(PyObject* module, PyObject* args, PyObject* kwds)
+{
+    static char* kwlist[] = { "path", "format", NULL };
+    const trace_format_t* format;
+    PyObject* path;
+    PyObject* name = NULL;
+
+    (void)module;
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "O|O", kwlist, &path, &name))
+        return NULL;
+    if (findFormat(name, &format) != 0)
+        return NULL;
+    return (PyObject*)loadTrace(path, format);
+}
+
+static PyObject* moduleSimulate(PyObject* module, PyObject* args, PyObject* kwds)
+{
+    static char* kwlist[] = { "trace", "s", "E", "b", "ops", "hit_bits", "format",
+                              "reorder", "huge_pages", "threads", NULL };
+    PyObject *trace, *ops = NULL, *hit_bits = NULL, *format = NULL;
+    int s, E, b, reorder = 0, huge_pages = 0, threads = 1;
+    PyObject* result;
+    csim_t* sim;
+
+    (void)module;
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "Oiii|$OOOppi", kwlist, &trace, &s, &E, &b,
+                                     &ops, &hit_bits, &format, &reorder, &huge_pages, &threads))
+        return NULL;
+    sim = createSim(s, E, b, reorder, huge_pages, threads);
+    if (sim == NULL)
+        return NULL;
+    /* Nobody else has sim, so no lock */
+    result = replayAny(sim, NULL, trace, ops, hit_bits, format);
+    Py_BEGIN_ALLOW_THREADS
+    csimFree(sim);
+    Py_END_ALLOW_THREADS
+    return result;
+}
+
+static PyObject* moduleFormats(PyObject* module, PyObject* unused)
+{
+    char names[256];
+
+    (void)module;
+    (void)unused;
+    traceFormatNames(names, sizeof(names));
+    return PyUnicode_FromString(names);
+}
+
+static PyMethodDef module_methods[] = {
+    { "simulate", (PyCFunction)(void (*)(void))moduleSimulate, METH_VARARGS | METH_KEYWORDS,
+      "simulate(trace, s, E, b, *, ops=None, hit_bits=None, format=None,\n"
+      "         reorder=False, huge_pages=False, threads=1) -> Stats\n\n"
+      "Simulate a cache of 2^s sets of E lines of 2^b bytes over a Trace, a\n"
+      "trace path or a buffer of 64-bit addresses (see Cache.access)." },
+    { "load_trace", (PyCFunction)(void (*)(void))moduleLoadTrace, METH_VARARGS | METH_KEYWORDS,
+      "load_trace(path, format=None) -> Trace\n\n"
+      "Decode a trace once, to replay it in any number of simulations." },
+    { "formats", (PyCFunction)moduleFormats, METH_NOARGS,
+      "formats() -> str\n\nThe names of the trace formats, comma separated." },
+    { NULL, NULL, 0, NULL },
+};
+
+static PySequenceMethods trace_as_sequence = {
+    .sq_length = (lenfunc)traceLength,
+};
+
+static PyTypeObject TraceType = {
+    PyVarObject_HEAD_INIT(NULL, 0)
+    .tp_name = "csim.Trace",
+    .tp_basicsize = sizeof(trace_object_t),
+    .tp_dealloc = (destructor)traceDealloc,
+    .tp_as_sequence = &trace_as_sequence,
+    .tp_flags = Py_TPFLAGS_DEFAULT,
+    .tp_doc = "A decoded trace, from load_trace(); len() is its number of records",
+};
+
+static PyTypeObject CacheType = {
+    PyVarObject_HEAD_INIT(NULL, 0)
+    .tp_name = "csim.Cache",
+    .tp_basicsize = sizeof(cache_object_t),
+    .tp_dealloc = (destructor)pyCacheDealloc,
+    .tp_flags = Py_TPFLAGS_DEFAULT,
+    .tp_doc = "Cache(s, E, b, *, reorder=False, huge_pages=False, threads=1)\n\n"
+              "A simulated cache of 2^s sets of E lines of 2^b bytes that keeps\n"
+              "its state between calls.",
+    .tp_methods = cache_methods,
+    .tp_init = (initproc)pyCacheInit,
+    .tp_new = PyType_GenericNew,
+};
+
+static struct PyModuleDef csim_module = {
+    PyModuleDef_HEAD_INIT,
+    .m_name = "csim",
+    .m_doc = "LRU cache simulator: the csim engine, without the process.",
+    .m_size = -1,
+    .m_methods = module_methods,
+};
+
+PyMODINIT_FUNC PyInit_csim(void)
+{
+    PyObject* module;
+
+    if (PyType_Ready(&TraceType) != 0 || PyType_Ready(&CacheType) != 0)
+        return NULL;
+    if (StatsType.tp_name == NULL && PyStructSequence_InitType2(&StatsType, &stats_desc) != 0)
+        return NULL;
+    module = PyModule_Create(&csim_module);
+    if (module == NULL)
+        return NULL;
+    Py_INCREF(&TraceType);
+    Py_INCREF(&CacheType);
+    Py_INCREF(&StatsType);
+    if (PyModule_AddObject(module, "Trace", (PyObject*)&TraceType) != 0 ||
+        PyModule_AddObject(module, "Cache", (PyObject*)&CacheType) != 0 ||
+        PyModule_AddObject(module, "Stats", (PyObject*)&StatsType) != 0) {
+        Py_DECREF(module);
+        return NULL;
+    }
+    return module;
+}
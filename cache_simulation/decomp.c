@@ -0,0 +1,403 @@
+/*
+ * decomp.c - Background decompression of compressed trace files
+ *
+ * The decoder thread reads the compressed input, decompresses it into
+ * one of DECOMP_SLOTS fixed-size slots and publishes the slot; the
+ * reader copies bytes out of published slots and hands them back.  When
+ * every slot is full the decoder waits, so memory use is bounded no
+ * matter how far ahead of the simulation decompression gets.
+ *
+ * gzip, xz and zstd are supported when built with HAVE_ZLIB, HAVE_LZMA
+ * and HAVE_ZSTD respectively.  Concatenated streams (pigz, pixz, zstd
+ * -T) are decoded as one.
+ */
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+#ifdef HAVE_LZMA
+#include <lzma.h>
+#endif
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+#include "decomp.h"
+
+#define DECOMP_SLOTS 8
+#define DECOMP_SLOT_SIZE (256 << 10)
+#define DECOMP_IN_SIZE (256 << 10)
+
+struct decomp {
+    int format;
+    int fd;                     /* compressed input, -1 if pre is all of it */
+    const unsigned char* pre;   /* input available before reading fd */
+    size_t pre_len;
+    unsigned char* in;          /* read buffer for fd */
+    pthread_t thread;
+    int started;
+
+    /* Bounded buffer: the decoder fills slots[head], the reader drains
+     * slots[tail] from offset off
+     */
+    pthread_mutex_t lock;
+    pthread_cond_t not_full;
+    pthread_cond_t not_empty;
+    unsigned char* slots[DECOMP_SLOTS];
+    size_t slot_len[DECOMP_SLOTS];
+    int head, tail, count;
+    size_t off;
+    int done;                   /* decoder has published its last slot */
+    int err;                    /* errno that ended decoding, 0 at clean end */
+    int stop;                   /* reader asked the decoder to quit */
+
+    /* Codec state */
+    int at_boundary;            /* between two concatenated streams */
+#ifdef HAVE_ZLIB
+    z_stream zs;
+#endif
+#ifdef HAVE_LZMA
+    lzma_stream xs;
+#endif
+#ifdef HAVE_ZSTD
+    ZSTD_DStream* ds;
+#endif
+};
+
+int decompDetect(const unsigned char* p, size_t len)
+{
+    if (len >= 2 && p[0] == 0x1f && p[1] == 0x8b)
+        return DECOMP_GZIP;
+    if (len >= 6 && memcmp(p, "\xfd" "7zXZ\0", 6) == 0)
+        return DECOMP_XZ;
+    if (len >= 4 && memcmp(p, "\x28\xb5\x2f\xfd", 4) == 0)
+        return DECOMP_ZSTD;
+    return DECOMP_NONE;
+}
+
+/* codecInit - set up the decoder for dec->format. Returns an errno value */
+static int codecInit(decomp_t* dec)
+{
+    switch (dec->format) {
+#ifdef HAVE_ZLIB
+    case DECOMP_GZIP:
+        /* 15 + 32: largest window, accept gzip and zlib headers */
+        return inflateInit2(&dec->zs, 15 + 32) == Z_OK ? 0 : ENOMEM;
+#endif
+#ifdef HAVE_LZMA
+    case DECOMP_XZ: {
+        lzma_stream init = LZMA_STREAM_INIT;
+        dec->xs = init;
+        return lzma_stream_decoder(&dec->xs, UINT64_MAX, LZMA_CONCATENATED)
+            == LZMA_OK ? 0 : ENOMEM;
+    }
+#endif
+#ifdef HAVE_ZSTD
+    case DECOMP_ZSTD:
+        dec->ds = ZSTD_createDStream();
+        if (dec->ds == NULL)
+            return ENOMEM;
+        dec->at_boundary = 1;
+        return ZSTD_isError(ZSTD_initDStream(dec->ds)) ? ENOMEM : 0;
+#endif
+    default:
+        return ENOTSUP;
+    }
+}
+
+/* codecRun - decompress from in into out, storing how much of each was
+ * used. in_eof says no input follows in. Returns 1 once all of the
+ * input has been decoded, -1 if it is corrupt, 0 otherwise.
+ */
+static int codecRun(decomp_t* dec, const unsigned char* in, size_t in_len,
+                    int in_eof, unsigned char* out, size_t out_len,
+                    size_t* used, size_t* made)
+{
+    *used = *made = 0;
+    switch (dec->format) {
+#ifdef HAVE_ZLIB
+    case DECOMP_GZIP: {
+        int rc;
+
+        if (in_len == 0 && in_eof && dec->at_boundary)
+            return 1;
+        dec->zs.next_in = (unsigned char*)in;
+        dec->zs.avail_in = in_len;
+        dec->zs.next_out = out;
+        dec->zs.avail_out = out_len;
+        rc = inflate(&dec->zs, Z_NO_FLUSH);
+        *used = in_len - dec->zs.avail_in;
+        *made = out_len - dec->zs.avail_out;
+        dec->at_boundary = 0;
+        if (rc == Z_STREAM_END) {
+            /* Another gzip member may follow */
+            inflateReset(&dec->zs);
+            dec->at_boundary = 1;
+            return 0;
+        }
+        return rc == Z_OK || rc == Z_BUF_ERROR ? 0 : -1;
+    }
+#endif
+#ifdef HAVE_LZMA
+    case DECOMP_XZ: {
+        lzma_ret rc;
+
+        dec->xs.next_in = in;
+        dec->xs.avail_in = in_len;
+        dec->xs.next_out = out;
+        dec->xs.avail_out = out_len;
+        rc = lzma_code(&dec->xs, in_eof ? LZMA_FINISH : LZMA_RUN);
+        *used = in_len - dec->xs.avail_in;
+        *made = out_len - dec->xs.avail_out;
+        if (rc == LZMA_STREAM_END)
+            return 1;
+        return rc == LZMA_OK || rc == LZMA_BUF_ERROR ? 0 : -1;
+    }
+#endif
+#ifdef HAVE_ZSTD
+    case DECOMP_ZSTD: {
+        ZSTD_inBuffer zin = { in, in_len, 0 };
+        ZSTD_outBuffer zout = { out, out_len, 0 };
+        size_t rc;
+
+        if (in_len == 0 && in_eof && dec->at_boundary)
+            return 1;
+        rc = ZSTD_decompressStream(dec->ds, &zout, &zin);
+        *used = zin.pos;
+        *made = zout.pos;
+        if (ZSTD_isError(rc))
+            return -1;
+        /* 0 means a frame was completely decoded and flushed */
+        dec->at_boundary = rc == 0;
+        return 0;
+    }
+#endif
+    default:
+        return -1;
+    }
+}
+
+static void codecEnd(decomp_t* dec)
+{
+    switch (dec->format) {
+#ifdef HAVE_ZLIB
+    case DECOMP_GZIP:
+        inflateEnd(&dec->zs);
+        break;
+#endif
+#ifdef HAVE_LZMA
+    case DECOMP_XZ:
+        lzma_end(&dec->xs);
+        break;
+#endif
+#ifdef HAVE_ZSTD
+    case DECOMP_ZSTD:
+        ZSTD_freeDStream(dec->ds);
+        break;
+#endif
+    default:
+        break;
+    }
+}
+
+/* slotAcquire - wait for a free slot. Returns NULL if asked to stop */
+static unsigned char* slotAcquire(decomp_t* dec)
+{
+    unsigned char* slot;
+
+    pthread_mutex_lock(&dec->lock);
+    while (dec->count == DECOMP_SLOTS && !dec->stop)
+        pthread_cond_wait(&dec->not_full, &dec->lock);
+    slot = dec->stop ? NULL : dec->slots[dec->head];
+    pthread_mutex_unlock(&dec->lock);
+    return slot;
+}
+
+/* slotPublish - hand the slot being filled to the reader */
+static void slotPublish(decomp_t* dec, size_t len)
+{
+    if (len == 0)
+        return;
+    pthread_mutex_lock(&dec->lock);
+    dec->slot_len[dec->head] = len;
+    dec->head = (dec->head + 1) % DECOMP_SLOTS;
+    dec->count++;
+    pthread_cond_signal(&dec->not_empty);
+    pthread_mutex_unlock(&dec->lock);
+}
+
+/* decompMain - decoder thread. Cancellation is only enabled while it is
+ * blocked in read(), where it holds no lock, so decompStop() can end it
+ * even if the input pipe never delivers another byte.
+ */
+static void* decompMain(void* arg)
+{
+    decomp_t* dec = (decomp_t*)arg;
+    const unsigned char* in = dec->pre;
+    size_t in_len = dec->pre_len;
+    int in_eof = dec->fd < 0;
+    unsigned char* out = NULL;
+    size_t out_len = 0;
+    int err = 0, finished = 0;
+
+    pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, NULL);
+    while (!finished && !err) {
+        if (in_len == 0 && !in_eof) {
+            ssize_t got;
+
+            /* Let the reader have what we have before blocking */
+            slotPublish(dec, out_len);
+            out = NULL;
+            pthread_setcancelstate(PTHREAD_CANCEL_ENABLE, NULL);
+            do {
+                got = read(dec->fd, dec->in, DECOMP_IN_SIZE);
+            } while (got < 0 && errno == EINTR);
+            pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, NULL);
+            if (got < 0) {
+                err = errno;
+                break;
+            }
+            in = dec->in;
+            in_len = got;
+            in_eof = got == 0;
+        }
+        if (out == NULL) {
+            out = slotAcquire(dec);
+            out_len = 0;
+            if (out == NULL)
+                break;
+        }
+
+        size_t used, made;
+        int rc = codecRun(dec, in, in_len, in_eof, out + out_len,
+                          DECOMP_SLOT_SIZE - out_len, &used, &made);
+        in += used;
+        in_len -= used;
+        out_len += made;
+        if (rc < 0 || (rc == 0 && in_eof && used == 0 && made == 0))
+            err = EBADMSG;   /* corrupt or truncated */
+        else if (rc > 0)
+            finished = 1;
+        if (out_len == DECOMP_SLOT_SIZE || finished || err) {
+            slotPublish(dec, out_len);
+            out = NULL;
+        }
+    }
+
+    pthread_mutex_lock(&dec->lock);
+    dec->done = 1;
+    dec->err = err;
+    pthread_cond_broadcast(&dec->not_empty);
+    pthread_mutex_unlock(&dec->lock);
+    return NULL;
+}
+
+decomp_t* decompStart(int format, int fd, const void* pre, size_t pre_len)
+{
+    decomp_t* dec = (decomp_t*)calloc(1, sizeof(decomp_t));
+    int err;
+
+    if (dec == NULL)
+        return NULL;
+    dec->format = format;
+    dec->fd = fd;
+    dec->pre = (const unsigned char*)pre;
+    dec->pre_len = pre_len;
+    pthread_mutex_init(&dec->lock, NULL);
+    pthread_cond_init(&dec->not_full, NULL);
+    pthread_cond_init(&dec->not_empty, NULL);
+
+    err = codecInit(dec);
+    if (err != 0) {
+        dec->format = DECOMP_NONE;
+        decompStop(dec);
+        errno = err;
+        return NULL;
+    }
+    if (fd >= 0 && (dec->in = (unsigned char*)malloc(DECOMP_IN_SIZE)) == NULL)
+        goto nomem;
+    for (int i = 0; i < DECOMP_SLOTS; i++) {
+        if ((dec->slots[i] = (unsigned char*)malloc(DECOMP_SLOT_SIZE)) == NULL)
+            goto nomem;
+    }
+    err = pthread_create(&dec->thread, NULL, decompMain, dec);
+    if (err != 0) {
+        decompStop(dec);
+        errno = err;
+        return NULL;
+    }
+    dec->started = 1;
+    return dec;
+
+nomem:
+    decompStop(dec);
+    errno = ENOMEM;
+    return NULL;
+}
+
+ssize_t decompRead(decomp_t* dec, void* dst, size_t len)
+{
+    unsigned char* slot;
+    size_t n;
+
+    pthread_mutex_lock(&dec->lock);
+    while (dec->count == 0 && !dec->done)
+        pthread_cond_wait(&dec->not_empty, &dec->lock);
+    if (dec->count == 0) {
+        int err = dec->err;
+        pthread_mutex_unlock(&dec->lock);
+        if (err != 0) {
+            errno = err;
+            return -1;
+        }
+        return 0;
+    }
+    slot = dec->slots[dec->tail];
+    n = dec->slot_len[dec->tail] - dec->off;
+    pthread_mutex_unlock(&dec->lock);
+
+    /* A published slot is not touched by the decoder until released */
+    if (n > len)
+        n = len;
+    memcpy(dst, slot + dec->off, n);
+
+    pthread_mutex_lock(&dec->lock);
+    dec->off += n;
+    if (dec->off == dec->slot_len[dec->tail]) {
+        dec->off = 0;
+        dec->tail = (dec->tail + 1) % DECOMP_SLOTS;
+        dec->count--;
+        pthread_cond_signal(&dec->not_full);
+    }
+    pthread_mutex_unlock(&dec->lock);
+    return n;
+}
+
+void decompStop(decomp_t* dec)
+{
+    if (dec == NULL)
+        return;
+    if (dec->started) {
+        pthread_mutex_lock(&dec->lock);
+        dec->stop = 1;
+        pthread_cond_broadcast(&dec->not_full);
+        pthread_mutex_unlock(&dec->lock);
+        pthread_cancel(dec->thread);
+        pthread_join(dec->thread, NULL);
+    }
+    codecEnd(dec);
+    pthread_mutex_destroy(&dec->lock);
+    pthread_cond_destroy(&dec->not_full);
+    pthread_cond_destroy(&dec->not_empty);
+    for (int i = 0; i < DECOMP_SLOTS; i++)
+        free(dec->slots[i]);
+    free(dec->in);
+    free(dec);
+}
@@ -0,0 +1,54 @@
+/*
+ * decomp.h - Background decompression of compressed trace files
+ *
+ * A decoder runs on its own thread and hands decompressed bytes to the
+ * trace reader through a bounded buffer, so decompression overlaps with
+ * the simulation.  Which formats are available depends on the libraries
+ * the simulator was built with (see the Makefile).
+ */
+
+#ifndef CACHELAB_DECOMP_H
+#define CACHELAB_DECOMP_H
+
+#include <stddef.h>
+#include <sys/types.h>
+
+/* Compression formats, recognized by their magic bytes */
+#define DECOMP_NONE 0
+#define DECOMP_GZIP 1
+#define DECOMP_XZ   2
+#define DECOMP_ZSTD 3
+
+/* Bytes decompDetect() needs to see */
+#define DECOMP_MAGIC_LEN 6
+
+typedef struct decomp decomp_t;
+
+/*
+ * decompDetect - Return the compression format of data starting with
+ *                the len bytes at p, DECOMP_NONE if it is not compressed.
+ */
+int decompDetect(const unsigned char* p, size_t len);
+
+/*
+ * decompStart - Start a decoder thread for the given format. The input
+ *               is the pre_len bytes at pre followed by whatever can be
+ *               read from fd (pass -1 if pre holds the whole input). pre
+ *               is not copied and must stay valid until decompStop().
+ *               Returns NULL and sets errno on failure, ENOTSUP if the
+ *               format was not compiled in.
+ */
+decomp_t* decompStart(int format, int fd, const void* pre, size_t pre_len);
+
+/*
+ * decompRead - Copy up to len decompressed bytes into dst, waiting for
+ *              the decoder if none are ready. Returns the number of
+ *              bytes, 0 at the end of the input, or -1 with errno set
+ *              if the input is corrupt or could not be read.
+ */
+ssize_t decompRead(decomp_t* dec, void* dst, size_t len);
+
+/* decompStop - Stop the decoder thread and free the decoder */
+void decompStop(decomp_t* dec);
+
+#endif /* CACHELAB_DECOMP_H */
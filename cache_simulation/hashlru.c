@@ -0,0 +1,205 @@
+/*
+ * hashlru.c - Hash-indexed LRU cache for very high associativity
+ *
+ * Lines are numbered set * E + way and a set hands out its ways in
+ * order until it is full. Each set keeps its lines on a doubly linked
+ * list, most recently used first; the links are arrays indexed by line,
+ * so the lists need no allocation. The hash table is keyed by block
+ * address (which determines the set), uses linear probing at a load of
+ * at most one half and deletes by shifting the rest of a cluster back,
+ * so it never fills up with tombstones.
+ */
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdlib.h>
+#include <errno.h>
+
+#include "hashlru.h"
+
+#define NONE (~0U)
+
+typedef struct hashlru_entry {
+    mem_addr_t block;
+    unsigned int line;      /* NONE if the slot is empty */
+} hashlru_entry_t;
+
+struct hashlru {
+    int b;
+    mem_addr_t set_mask;
+    unsigned int ways;
+
+    mem_addr_t* blocks;     /* block in each line */
+    unsigned int* prev;     /* recency list links by line */
+    unsigned int* next;
+    unsigned int* mru;      /* per set: most recently used line */
+    unsigned int* lru;      /* per set: least recently used line */
+    unsigned int* fill;     /* per set: lines in use */
+
+    hashlru_entry_t* table;
+    size_t table_mask;
+    int table_shift;        /* 64 - log2(table size) */
+};
+
+/* slotOf - home slot of a block in the table (Fibonacci hashing) */
+static size_t slotOf(const hashlru_t* hl, mem_addr_t block)
+{
+    return (size_t)((block * 0x9e3779b97f4a7c15ULL) >> hl->table_shift);
+}
+
+/* tableRemove - delete the entry in slot i, moving later entries of its
+ * cluster back so that no lookup stops short of them
+ */
+static void tableRemove(hashlru_t* hl, size_t i)
+{
+    size_t j = i;
+
+    for (;;) {
+        j = (j + 1) & hl->table_mask;
+        if (hl->table[j].line == NONE)
+            break;
+        /* The entry in j may fill the hole at i unless its home slot
+         * lies cyclically in (i, j]
+         */
+        size_t home = slotOf(hl, hl->table[j].block);
+        if (((j - home) & hl->table_mask) >= ((j - i) & hl->table_mask)) {
+            hl->table[i] = hl->table[j];
+            i = j;
+        }
+    }
+    hl->table[i].line = NONE;
+}
+
+/* listRemove - unlink line from the recency list of set */
+static void listRemove(hashlru_t* hl, size_t set, unsigned int line)
+{
+    unsigned int p = hl->prev[line], n = hl->next[line];
+
+    if (p != NONE)
+        hl->next[p] = n;
+    else
+        hl->mru[set] = n;
+    if (n != NONE)
+        hl->prev[n] = p;
+    else
+        hl->lru[set] = p;
+}
+
+/* listPush - make line the most recently used of set */
+static void listPush(hashlru_t* hl, size_t set, unsigned int line)
+{
+    unsigned int first = hl->mru[set];
+
+    hl->prev[line] = NONE;
+    hl->next[line] = first;
+    if (first != NONE)
+        hl->prev[first] = line;
+    else
+        hl->lru[set] = line;
+    hl->mru[set] = line;
+}
+
+hashlru_t* hashlruCreate(int s, int E, int b)
+{
+    size_t sets = (size_t)1 << s;
+    size_t lines = sets * (size_t)E;
+    size_t table_size = 1;
+    int table_bits = 0;
+    hashlru_t* hl;
+
+    if (E <= 0 || lines / sets != (size_t)E || lines >= NONE) {
+        errno = EINVAL;
+        return NULL;
+    }
+    while (table_size < 2 * lines) {
+        table_size <<= 1;
+        table_bits++;
+    }
+
+    hl = (hashlru_t*)calloc(1, sizeof(hashlru_t));
+    if (hl == NULL)
+        return NULL;
+    hl->b = b;
+    hl->set_mask = sets - 1;
+    hl->ways = E;
+    hl->table_mask = table_size - 1;
+    hl->table_shift = 64 - table_bits;
+    hl->blocks = (mem_addr_t*)malloc(lines * sizeof(mem_addr_t));
+    hl->prev = (unsigned int*)malloc(lines * sizeof(unsigned int));
+    hl->next = (unsigned int*)malloc(lines * sizeof(unsigned int));
+    hl->mru = (unsigned int*)malloc(sets * sizeof(unsigned int));
+    hl->lru = (unsigned int*)malloc(sets * sizeof(unsigned int));
+    hl->fill = (unsigned int*)calloc(sets, sizeof(unsigned int));
+    hl->table = (hashlru_entry_t*)malloc(table_size * sizeof(hashlru_entry_t));
+    if (hl->blocks == NULL || hl->prev == NULL || hl->next == NULL ||
+        hl->mru == NULL || hl->lru == NULL || hl->fill == NULL ||
+        hl->table == NULL) {
+        hashlruFree(hl);
+        errno = ENOMEM;
+        return NULL;
+    }
+    for (size_t i = 0; i < sets; i++)
+        hl->mru[i] = hl->lru[i] = NONE;
+    for (size_t i = 0; i < table_size; i++)
+        hl->table[i].line = NONE;
+    return hl;
+}
+
+int hashlruAccess(hashlru_t* hl, mem_addr_t addr)
+{
+    mem_addr_t block = addr >> hl->b;
+    size_t set = block & hl->set_mask;
+    size_t i = slotOf(hl, block);
+    unsigned int line;
+    int outcome = HASHLRU_MISS;
+
+    for (; hl->table[i].line != NONE; i = (i + 1) & hl->table_mask) {
+        if (hl->table[i].block == block) {
+            line = hl->table[i].line;
+            if (hl->mru[set] != line) {
+                listRemove(hl, set, line);
+                listPush(hl, set, line);
+            }
+            return HASHLRU_HIT;
+        }
+    }
+
+    if (hl->fill[set] < hl->ways) {
+        line = set * hl->ways + hl->fill[set]++;
+    } else {
+        /* Evict the least recently used line; its block is in the table
+         * for sure, so the probe ends at it
+         */
+        line = hl->lru[set];
+        listRemove(hl, set, line);
+        size_t j = slotOf(hl, hl->blocks[line]);
+        while (hl->table[j].line != line)
+            j = (j + 1) & hl->table_mask;
+        tableRemove(hl, j);
+        outcome = HASHLRU_EVICT;
+
+        /* The removal may have moved entries into the cluster we probed */
+        i = slotOf(hl, block);
+        while (hl->table[i].line != NONE)
+            i = (i + 1) & hl->table_mask;
+    }
+
+    hl->blocks[line] = block;
+    listPush(hl, set, line);
+    hl->table[i].block = block;
+    hl->table[i].line = line;
+    return outcome;
+}
+
+void hashlruFree(hashlru_t* hl)
+{
+    if (hl == NULL)
+        return;
+    free(hl->blocks);
+    free(hl->prev);
+    free(hl->next);
+    free(hl->mru);
+    free(hl->lru);
+    free(hl->fill);
+    free(hl->table);
+    free(hl);
+}
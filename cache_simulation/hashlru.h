@@ -0,0 +1,38 @@
+/*
+ * hashlru.h - Hash-indexed LRU cache for very high associativity
+ *
+ * A set-associative LRU cache whose lookups and evictions take constant
+ * time however many ways a set has: a hash table maps every cached block
+ * to its line, and the lines of each set are kept on an intrusive list in
+ * recency order. Meant for fully-associative caches (one set) and others
+ * with too many ways to scan on every access.
+ */
+
+#ifndef CACHELAB_HASHLRU_H
+#define CACHELAB_HASHLRU_H
+
+#include "trace.h"
+
+/* Outcomes of hashlruAccess() */
+#define HASHLRU_HIT   0
+#define HASHLRU_MISS  1
+#define HASHLRU_EVICT 2     /* a miss that evicted a line */
+
+typedef struct hashlru hashlru_t;
+
+/*
+ * hashlruCreate - Create an empty cache of 2^s sets of E lines of 2^b
+ *                 bytes. Returns NULL and sets errno on failure.
+ */
+hashlru_t* hashlruCreate(int s, int E, int b);
+
+/*
+ * hashlruAccess - Access the block holding addr and return HASHLRU_HIT,
+ *                 HASHLRU_MISS or HASHLRU_EVICT
+ */
+int hashlruAccess(hashlru_t* hl, mem_addr_t addr);
+
+/* hashlruFree - Free the cache */
+void hashlruFree(hashlru_t* hl);
+
+#endif /* CACHELAB_HASHLRU_H */
@@ -0,0 +1,158 @@
+/*
+ * libcsim.c - The cache simulator as a library
+ *
+ * A thin layer over cache.c and shard.c: it picks one of them for the
+ * configuration and collects single accesses into a batch, so callers
+ * that simulate one access at a time still go through the batched
+ * replay kernels. Accesses given as arrays are copied into trace
+ * records a batch at a time for the same reason.
+ */
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdlib.h>
+#include <errno.h>
+
+#include "libcsim.h"
+#include "shard.h"
+
+/* Accesses given as arrays are copied this many at a time, few enough
+ * that the copy is still in the host's L1 when the kernel reads it
+ */
+#define ARRAY_CHUNK 1024
+
+struct csim {
+    cache_t* cache;     /* the cache, unless it is sharded */
+    shard_t* shard;
+    size_t pending;     /* accesses waiting in batch */
+    trace_rec_t batch[TRACE_BATCH];
+};
+
+/* flush - simulate the buffered accesses */
+static void flush(csim_t* sim)
+{
+    if (sim->pending == 0)
+        return;
+    if (sim->shard != NULL)
+        shardReplay(sim->shard, sim->batch, sim->pending);
+    else
+        cacheReplay(sim->cache, sim->batch, sim->pending);
+    sim->pending = 0;
+}
+
+csim_t* csimCreate(const csim_config_t* config)
+{
+    csim_t* sim;
+
+    if (config == NULL) {
+        errno = EINVAL;
+        return NULL;
+    }
+    sim = (csim_t*)calloc(1, sizeof(csim_t));
+    if (sim == NULL)
+        return NULL;
+    /* Slices replay out of order, so verbose output needs one thread */
+    if (config->threads > 1 && config->s > 0 && !(config->flags & CACHE_VERBOSE))
+        sim->shard = shardStart(config->s, config->E, config->b, config->flags, config->threads);
+    else
+        sim->cache = cacheCreate(config->s, config->E, config->b, config->flags);
+    if (sim->cache == NULL && sim->shard == NULL) {
+        free(sim);
+        return NULL;
+    }
+    return sim;
+}
+
+int csimAccess(csim_t* sim, mem_addr_t addr, unsigned int size, char op)
+{
+    if (op != 'L' && op != 'S' && op != 'M') {
+        if (op == 'I')
+            return 0;
+        errno = EINVAL;
+        return -1;
+    }
+    sim->batch[sim->pending].addr = addr;
+    sim->batch[sim->pending].size = size;
+    sim->batch[sim->pending].op = op;
+    if (++sim->pending == TRACE_BATCH)
+        flush(sim);
+    return 0;
+}
+
+void csimAccessBatch(csim_t* sim, const trace_rec_t* recs, size_t n)
+{
+    flush(sim);
+    if (sim->shard != NULL)
+        shardReplay(sim->shard, recs, n);
+    else
+        cacheReplay(sim->cache, recs, n);
+}
+
+int csimAccessArrays(csim_t* sim, const mem_addr_t* addrs, const char* ops, size_t n,
+                     cache_stats_t* delta, unsigned char* hit_bits)
+{
+    cache_stats_t before, after;
+    int bad = 0;
+
+    /* Without an early exit, so the check vectorizes */
+    for (size_t i = 0; ops != NULL && i < n; i++)
+        bad |= ops[i] != 'L' && ops[i] != 'S' && ops[i] != 'M';
+    if (bad) {
+        errno = EINVAL;
+        return -1;
+    }
+    /* Slices replay out of order */
+    if (hit_bits != NULL && sim->shard != NULL) {
+        errno = EINVAL;
+        return -1;
+    }
+    if (delta != NULL)
+        csimStats(sim, &before);
+    else
+        flush(sim);
+
+    /* ARRAY_CHUNK is a multiple of 8, so every chunk starts a byte */
+    for (size_t done = 0; done < n; done += ARRAY_CHUNK) {
+        size_t m = n - done < ARRAY_CHUNK ? n - done : ARRAY_CHUNK;
+
+        if (ops != NULL) {
+            for (size_t i = 0; i < m; i++)
+                sim->batch[i] = (trace_rec_t){ addrs[done + i], 0, ops[done + i] };
+        } else {
+            for (size_t i = 0; i < m; i++)
+                sim->batch[i] = (trace_rec_t){ addrs[done + i], 0, 'L' };
+        }
+        if (hit_bits != NULL)
+            cacheReplayOutcomes(sim->cache, sim->batch, m, hit_bits + done / 8);
+        else if (sim->shard != NULL)
+            shardReplay(sim->shard, sim->batch, m);
+        else
+            cacheReplay(sim->cache, sim->batch, m);
+    }
+
+    if (delta != NULL) {
+        csimStats(sim, &after);
+        delta->hits = after.hits - before.hits;
+        delta->misses = after.misses - before.misses;
+        delta->evictions = after.evictions - before.evictions;
+    }
+    return 0;
+}
+
+void csimStats(csim_t* sim, cache_stats_t* stats)
+{
+    flush(sim);
+    if (sim->shard != NULL)
+        shardStats(sim->shard, stats);
+    else
+        cacheStats(sim->cache, stats);
+}
+
+void csimFree(csim_t* sim)
+{
+    if (sim == NULL)
+        return;
+    if (sim->shard != NULL)
+        shardStop(sim->shard, NULL);
+    cacheFree(sim->cache);
+    free(sim);
+}
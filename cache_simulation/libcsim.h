@@ -0,0 +1,71 @@
+/*
+ * libcsim.h - The cache simulator as a library
+ *
+ * A csim_t is one simulation: a cache, or with threads, the slices of
+ * one cache on that many threads, and its counts. Simulations share no
+ * state, so a program can run any number of them, each from its own
+ * thread; one simulation must not be used from two threads at once.
+ * Link with libcsim.a (and -pthread).
+ */
+
+#ifndef CACHELAB_LIBCSIM_H
+#define CACHELAB_LIBCSIM_H
+
+#include "cache.h"
+#include "trace.h"
+
+/* Type: What to simulate */
+typedef struct csim_config {
+    int s;          /* set index bits, 0 for a fully associative cache */
+    int E;          /* lines per set */
+    int b;          /* block offset bits */
+    int flags;      /* cacheCreate() flags */
+    int threads;    /* split the sets among this many threads; 0 or 1:
+                     * simulate on the calling thread */
+} csim_config_t;
+
+typedef struct csim csim_t;
+
+/*
+ * csimCreate - Create a simulation of an empty cache. Returns NULL and
+ *              sets errno on failure.
+ */
+csim_t* csimCreate(const csim_config_t* config);
+
+/*
+ * csimAccess - Simulate one access of size bytes at addr: op is 'L'
+ *              (load), 'S' (store) or 'M' (modify: a load and a store);
+ *              'I' (instruction fetch) is ignored. Accesses are buffered
+ *              and simulated a batch at a time. Returns -1 and sets
+ *              errno to EINVAL for any other op.
+ */
+int csimAccess(csim_t* sim, mem_addr_t addr, unsigned int size, char op);
+
+/*
+ * csimAccessBatch - Simulate n trace records, after any accesses
+ *                   still buffered; every op must be 'L', 'S' or 'M'
+ */
+void csimAccessBatch(csim_t* sim, const trace_rec_t* recs, size_t n);
+
+/*
+ * csimAccessArrays - Simulate n accesses given as arrays, after any
+ *                    still buffered: access i is at addrs[i], with op
+ *                    ops[i] ('L', 'S' or 'M'; all loads if ops is NULL).
+ *                    If delta is not NULL, it gets the hits, misses and
+ *                    evictions of just these accesses. If hit_bits is
+ *                    not NULL, bit i % 8 of hit_bits[i / 8] is set if
+ *                    access i hit and cleared if it missed (for an M,
+ *                    its load). Returns -1 and sets errno to EINVAL,
+ *                    simulating nothing, for any other op, or for
+ *                    hit_bits with more than one thread.
+ */
+int csimAccessArrays(csim_t* sim, const mem_addr_t* addrs, const char* ops, size_t n,
+                     cache_stats_t* delta, unsigned char* hit_bits);
+
+/* csimStats - Get the hits, misses and evictions of all accesses so far */
+void csimStats(csim_t* sim, cache_stats_t* stats);
+
+/* csimFree - Free the simulation */
+void csimFree(csim_t* sim);
+
+#endif /* CACHELAB_LIBCSIM_H */
@@ -0,0 +1,251 @@
+/*
+ * lockstep.c - Small caches simulated in lockstep
+ *
+ * Each set keeps its lines most recently used first, so a set of two
+ * needs no LRU state: a hit in the second line swaps the two, a miss
+ * shifts the first line down and evicts the second if it was valid.
+ * Empty lines hold TAG_INVALID and sink to the bottom, so a set fills
+ * up before it evicts.
+ *
+ * The AVX2 kernel writes every set back, the accessed block first,
+ * whether it hit or not: that keeps it free of branches, which the
+ * high miss rates of small caches would mispredict constantly. The sets
+ * of all the caches live in one array, so the AVX2 kernel can look up
+ * four caches with one gather. Lanes past the last cache pad the group
+ * to a multiple of four; they simulate a one-set cache that nobody asks
+ * about. The second access of an M always hits, in every cache, so those
+ * are only counted.
+ */
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include "lockstep.h"
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#define LOCKSTEP_AVX2 1
+#endif
+
+/*
+ * Largest cache, in lines, the AVX2 kernel is used for. Bigger caches
+ * hit often enough that the scalar kernel, which returns early on a hit
+ * in the first line, is faster than writing every set back.
+ */
+#define LOCKSTEP_SIMD_LINES 256
+
+typedef void (*lockstep_kernel_t)(lockstep_t* ls, const trace_rec_t* recs, size_t n);
+
+struct lockstep {
+    int lanes;                  /* caches, padded to a multiple of 4 */
+    int ways;
+    lockstep_kernel_t replay;
+    mem_addr_t* tags;           /* every cache's sets, cache after cache */
+
+    /* Per lane, as 64-bit integers so four of them fill a vector */
+    long long offset[LOCKSTEP_LANES];     /* index of the first tag */
+    long long set_shift[LOCKSTEP_LANES];  /* b */
+    long long tag_shift[LOCKSTEP_LANES];  /* s + b */
+    long long set_mask[LOCKSTEP_LANES];   /* 2^s - 1 */
+
+    unsigned long long hits[LOCKSTEP_LANES];
+    unsigned long long misses[LOCKSTEP_LANES];
+    unsigned long long evictions[LOCKSTEP_LANES];
+    unsigned long long modifies;    /* M records so far */
+};
+
+/* replayLanes - replays a batch against every lane, one after another */
+static inline __attribute__((always_inline))
+void replayLanes(lockstep_t* ls, const trace_rec_t* recs, size_t n, const int ways)
+{
+    for (size_t r = 0; r < n; r++) {
+        mem_addr_t addr = recs[r].addr;
+
+        for (int lane = 0; lane < ls->lanes; lane++) {
+            size_t set = (addr >> ls->set_shift[lane]) & ls->set_mask[lane];
+            mem_addr_t tag = addr >> ls->tag_shift[lane];
+            mem_addr_t* line = ls->tags + ls->offset[lane] + set * ways;
+            mem_addr_t last = line[ways - 1];
+
+            if (line[0] == tag) {
+                ls->hits[lane]++;
+                continue;
+            }
+            if (ways == 2 && last == tag) {
+                ls->hits[lane]++;
+            } else {
+                ls->misses[lane]++;
+                ls->evictions[lane] += last != TAG_INVALID;
+            }
+            if (ways == 2)
+                line[1] = line[0];
+            line[0] = tag;
+        }
+        ls->modifies += recs[r].op == 'M';
+    }
+}
+
+static void replay1(lockstep_t* ls, const trace_rec_t* recs, size_t n)
+{
+    replayLanes(ls, recs, n, 1);
+}
+
+static void replay2(lockstep_t* ls, const trace_rec_t* recs, size_t n)
+{
+    replayLanes(ls, recs, n, 2);
+}
+
+#ifdef LOCKSTEP_AVX2
+/* replayAvx2 - replays a batch against four lanes per vector, gathering
+ * the lines of each lane's set at once and writing them back one by one
+ */
+static inline __attribute__((target("avx2")))
+void replayAvx2(lockstep_t* ls, const trace_rec_t* recs, size_t n, const int ways)
+{
+    const int groups = ls->lanes / 4;
+    long long* tags = (long long*)ls->tags;
+    const __m256i ones = _mm256_set1_epi64x(-1);
+    __m256i offset[LOCKSTEP_LANES / 4], set_shift[LOCKSTEP_LANES / 4];
+    __m256i tag_shift[LOCKSTEP_LANES / 4], set_mask[LOCKSTEP_LANES / 4];
+    __m256i hits[LOCKSTEP_LANES / 4], evictions[LOCKSTEP_LANES / 4];
+
+    for (int g = 0; g < groups; g++) {
+        offset[g] = _mm256_loadu_si256((const __m256i*)&ls->offset[4 * g]);
+        set_shift[g] = _mm256_loadu_si256((const __m256i*)&ls->set_shift[4 * g]);
+        tag_shift[g] = _mm256_loadu_si256((const __m256i*)&ls->tag_shift[4 * g]);
+        set_mask[g] = _mm256_loadu_si256((const __m256i*)&ls->set_mask[4 * g]);
+        hits[g] = _mm256_setzero_si256();
+        evictions[g] = _mm256_setzero_si256();
+    }
+
+    for (size_t r = 0; r < n; r++) {
+        __m256i a = _mm256_set1_epi64x((long long)recs[r].addr);
+
+        for (int g = 0; g < groups; g++) {
+            __m256i set = _mm256_and_si256(_mm256_srlv_epi64(a, set_shift[g]), set_mask[g]);
+            __m256i tag = _mm256_srlv_epi64(a, tag_shift[g]);
+            __m256i idx = _mm256_add_epi64(offset[g], ways == 2 ? _mm256_slli_epi64(set, 1) : set);
+            __m256i first = _mm256_i64gather_epi64(tags, idx, 8);
+            __m256i last = first, hit = _mm256_cmpeq_epi64(first, tag);
+            long long at[4], to[4], second[4];
+
+            if (ways == 2) {
+                __m256i first_hit = hit;
+
+                last = _mm256_i64gather_epi64(tags, _mm256_add_epi64(idx, _mm256_set1_epi64x(1)), 8);
+                hit = _mm256_or_si256(hit, _mm256_cmpeq_epi64(last, tag));
+                _mm256_storeu_si256((__m256i*)second, _mm256_blendv_epi8(first, last, first_hit));
+            }
+            /* A match is -1; a miss evicts unless the last line was empty */
+            hits[g] = _mm256_sub_epi64(hits[g], hit);
+            evictions[g] = _mm256_sub_epi64(evictions[g], _mm256_xor_si256(ones,
+                    _mm256_or_si256(hit, _mm256_cmpeq_epi64(last, ones))));
+
+            _mm256_storeu_si256((__m256i*)at, idx);
+            _mm256_storeu_si256((__m256i*)to, tag);
+            for (int i = 0; i < 4; i++) {
+                if (ways == 2)
+                    tags[at[i] + 1] = second[i];
+                tags[at[i]] = to[i];
+            }
+        }
+        ls->modifies += recs[r].op == 'M';
+    }
+
+    for (int g = 0; g < groups; g++) {
+        long long counts[4], evicted[4];
+
+        _mm256_storeu_si256((__m256i*)counts, hits[g]);
+        _mm256_storeu_si256((__m256i*)evicted, evictions[g]);
+        for (int i = 0; i < 4; i++) {
+            ls->hits[4 * g + i] += counts[i];
+            ls->misses[4 * g + i] += n - counts[i];
+            ls->evictions[4 * g + i] += evicted[i];
+        }
+    }
+}
+
+static __attribute__((target("avx2"), flatten))
+void replay1Avx2(lockstep_t* ls, const trace_rec_t* recs, size_t n)
+{
+    replayAvx2(ls, recs, n, 1);
+}
+
+static __attribute__((target("avx2"), flatten))
+void replay2Avx2(lockstep_t* ls, const trace_rec_t* recs, size_t n)
+{
+    replayAvx2(ls, recs, n, 2);
+}
+#endif /* LOCKSTEP_AVX2 */
+
+lockstep_t* lockstepCreate(int lanes, const int* s, int E, const int* b)
+{
+    lockstep_t* ls;
+    size_t len = 0, most = 0;
+
+    if (lanes <= 0 || lanes > LOCKSTEP_LANES || E <= 0 || E > LOCKSTEP_MAX_WAYS) {
+        errno = EINVAL;
+        return NULL;
+    }
+    for (int i = 0; i < lanes; i++) {
+        if (s[i] < 0 || b[i] < 0 || s[i] + b[i] == 0 || s[i] + b[i] >= 64) {
+            errno = EINVAL;
+            return NULL;
+        }
+    }
+    ls = (lockstep_t*)calloc(1, sizeof(lockstep_t));
+    if (ls == NULL)
+        return NULL;
+    ls->lanes = (lanes + 3) & ~3;
+    ls->ways = E;
+    for (int i = 0; i < ls->lanes; i++) {
+        /* Padding lanes: one set, tags the whole address */
+        ls->offset[i] = len;
+        ls->set_shift[i] = i < lanes ? b[i] : 0;
+        ls->tag_shift[i] = i < lanes ? s[i] + b[i] : 0;
+        ls->set_mask[i] = i < lanes ? ((long long)1 << s[i]) - 1 : 0;
+        if ((size_t)ls->set_mask[i] + 1 > (((size_t)-1) / sizeof(mem_addr_t) - len) / E) {
+            free(ls);
+            errno = ENOMEM;
+            return NULL;
+        }
+        len += ((size_t)ls->set_mask[i] + 1) * E;
+        if (((size_t)ls->set_mask[i] + 1) * E > most)
+            most = ((size_t)ls->set_mask[i] + 1) * E;
+    }
+    if (posix_memalign((void**)&ls->tags, HOST_CACHE_LINE, len * sizeof(mem_addr_t)) != 0) {
+        free(ls);
+        errno = ENOMEM;
+        return NULL;
+    }
+    memset(ls->tags, 0xff, len * sizeof(mem_addr_t));     /* TAG_INVALID */
+
+    ls->replay = E == 1 ? replay1 : replay2;
+#ifdef LOCKSTEP_AVX2
+    if (most <= LOCKSTEP_SIMD_LINES && __builtin_cpu_supports("avx2"))
+        ls->replay = E == 1 ? replay1Avx2 : replay2Avx2;
+#endif
+    return ls;
+}
+
+void lockstepReplay(lockstep_t* ls, const trace_rec_t* recs, size_t n)
+{
+    ls->replay(ls, recs, n);
+}
+
+void lockstepStats(const lockstep_t* ls, int lane, cache_stats_t* stats)
+{
+    stats->hits = ls->hits[lane] + ls->modifies;
+    stats->misses = ls->misses[lane];
+    stats->evictions = ls->evictions[lane];
+}
+
+void lockstepFree(lockstep_t* ls)
+{
+    if (ls == NULL)
+        return;
+    free(ls->tags);
+    free(ls);
+}
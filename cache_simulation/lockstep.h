@@ -0,0 +1,40 @@
+/*
+ * lockstep.h - Small caches simulated in lockstep
+ *
+ * A direct-mapped or 2-way cache does so little work per access that
+ * replaying a trace against it is mostly loop overhead. A lockstep group
+ * advances up to LOCKSTEP_LANES such caches, each with its own s and b
+ * but all with the same E, over the records together: one pass, with
+ * the set indices, tags and lookups of all the caches computed side by
+ * side in SIMD lanes where the CPU has AVX2.
+ */
+
+#ifndef CACHELAB_LOCKSTEP_H
+#define CACHELAB_LOCKSTEP_H
+
+#include "cache.h"
+#include "trace.h"
+
+/* Most caches in a group, and most lines per set */
+#define LOCKSTEP_LANES 16
+#define LOCKSTEP_MAX_WAYS 2
+
+typedef struct lockstep lockstep_t;
+
+/*
+ * lockstepCreate - Create empty caches of 2^s[i] sets of E lines of
+ *                  2^b[i] bytes, for i from 0 to lanes - 1. Returns NULL
+ *                  and sets errno on failure.
+ */
+lockstep_t* lockstepCreate(int lanes, const int* s, int E, const int* b);
+
+/* lockstepReplay - Replay n trace records against all the caches */
+void lockstepReplay(lockstep_t* ls, const trace_rec_t* recs, size_t n);
+
+/* lockstepStats - Get the hits, misses and evictions of cache lane */
+void lockstepStats(const lockstep_t* ls, int lane, cache_stats_t* stats);
+
+/* lockstepFree - Free all the caches */
+void lockstepFree(lockstep_t* ls);
+
+#endif /* CACHELAB_LOCKSTEP_H */
@@ -0,0 +1,155 @@
+/*
+ * pipeline.c - Reader/simulator pipeline
+ *
+ * The ring is indexed by two free-running counters: the producer only
+ * writes head, the consumer only writes tail, and each publishes with a
+ * release store that the other side reads with an acquire load.  They
+ * live on separate cache lines so the two threads do not bounce one
+ * line between them on every batch.  A side that finds the ring full
+ * (or empty) spins briefly and then yields.
+ */
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdlib.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+
+#include "pipeline.h"
+
+#define CACHE_LINE 64
+#define SPIN_LIMIT 256
+
+struct pipeline {
+    trace_reader_t* reader;
+    pthread_t thread;
+    trace_rec_t (*batches)[TRACE_BATCH];
+    size_t counts[PIPELINE_SLOTS];
+
+    /* Producer side */
+    size_t head __attribute__((aligned(CACHE_LINE)));
+    int done;                   /* head will not move again */
+    unsigned long long full_stalls;
+
+    /* Consumer side */
+    size_t tail __attribute__((aligned(CACHE_LINE)));
+    int holding;                /* batch at tail is out with the caller */
+    int stop;                   /* consumer is going away */
+    unsigned long long empty_stalls;
+    unsigned long long taken;
+    unsigned long long occupancy;
+};
+
+/* backoff - wait a little longer each time a side finds nothing to do */
+static void backoff(unsigned int* spins)
+{
+    if (++*spins < SPIN_LIMIT)
+        __builtin_ia32_pause();
+    else
+        sched_yield();
+}
+
+static void* pipelineMain(void* arg)
+{
+    pipeline_t* pl = (pipeline_t*)arg;
+    size_t head = pl->head;
+
+    for (;;) {
+        if (head - __atomic_load_n(&pl->tail, __ATOMIC_ACQUIRE) == PIPELINE_SLOTS) {
+            unsigned int spins = 0;
+
+            pl->full_stalls++;
+            while (head - __atomic_load_n(&pl->tail, __ATOMIC_ACQUIRE) == PIPELINE_SLOTS) {
+                if (__atomic_load_n(&pl->stop, __ATOMIC_ACQUIRE))
+                    goto out;
+                backoff(&spins);
+            }
+        }
+
+        size_t slot = head % PIPELINE_SLOTS;
+        pl->counts[slot] = traceRead(pl->reader, pl->batches[slot], TRACE_BATCH);
+        if (pl->counts[slot] == 0)
+            break;
+        __atomic_store_n(&pl->head, ++head, __ATOMIC_RELEASE);
+    }
+out:
+    __atomic_store_n(&pl->done, 1, __ATOMIC_RELEASE);
+    return NULL;
+}
+
+pipeline_t* pipelineStart(trace_reader_t* reader)
+{
+    pipeline_t* pl;
+    int err;
+
+    if (posix_memalign((void**)&pl, CACHE_LINE, sizeof(pipeline_t)) != 0) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    *pl = (pipeline_t){ 0 };
+    pl->reader = reader;
+    pl->batches = malloc(PIPELINE_SLOTS * sizeof(*pl->batches));
+    if (pl->batches == NULL) {
+        free(pl);
+        errno = ENOMEM;
+        return NULL;
+    }
+    err = pthread_create(&pl->thread, NULL, pipelineMain, pl);
+    if (err != 0) {
+        free(pl->batches);
+        free(pl);
+        errno = err;
+        return NULL;
+    }
+    return pl;
+}
+
+const trace_rec_t* pipelineNext(pipeline_t* pl, size_t* n)
+{
+    size_t tail = pl->tail;
+    size_t head;
+
+    /* Hand the previous batch back to the producer */
+    if (pl->holding) {
+        __atomic_store_n(&pl->tail, ++tail, __ATOMIC_RELEASE);
+        pl->holding = 0;
+    }
+
+    head = __atomic_load_n(&pl->head, __ATOMIC_ACQUIRE);
+    if (head == tail) {
+        unsigned int spins = 0;
+
+        pl->empty_stalls++;
+        for (;;) {
+            /* done is published after the last head, so check it first */
+            int done = __atomic_load_n(&pl->done, __ATOMIC_ACQUIRE);
+            head = __atomic_load_n(&pl->head, __ATOMIC_ACQUIRE);
+            if (head != tail)
+                break;
+            if (done)
+                return NULL;
+            backoff(&spins);
+        }
+    }
+
+    pl->taken++;
+    pl->occupancy += head - tail;
+    pl->holding = 1;
+    *n = pl->counts[tail % PIPELINE_SLOTS];
+    return pl->batches[tail % PIPELINE_SLOTS];
+}
+
+void pipelineStop(pipeline_t* pl, pipeline_stats_t* stats)
+{
+    __atomic_store_n(&pl->stop, 1, __ATOMIC_RELEASE);
+    pthread_join(pl->thread, NULL);
+
+    if (stats != NULL) {
+        stats->batches = pl->taken;
+        stats->full_stalls = pl->full_stalls;
+        stats->empty_stalls = pl->empty_stalls;
+        stats->avg_occupancy = pl->taken ? (double)pl->occupancy / pl->taken : 0;
+    }
+    free(pl->batches);
+    free(pl);
+}
@@ -0,0 +1,49 @@
+/*
+ * pipeline.h - Reader/simulator pipeline
+ *
+ * A producer thread decodes the trace into fixed-size record batches and
+ * pushes them through a lock-free single-producer/single-consumer ring;
+ * the simulator consumes the batches on the calling thread.  The ring is
+ * bounded, so a reader that gets ahead waits for the simulator.
+ */
+
+#ifndef CACHELAB_PIPELINE_H
+#define CACHELAB_PIPELINE_H
+
+#include "trace.h"
+
+/* Batches in the ring */
+#define PIPELINE_SLOTS 64
+
+typedef struct pipeline pipeline_t;
+
+/* Type: Pipeline statistics
+ * A ring that is mostly full with frequent reader stalls means the
+ * simulator is the bottleneck; a mostly empty ring with frequent
+ * simulator stalls means the reader is.
+ */
+typedef struct pipeline_stats {
+    unsigned long long batches;
+    unsigned long long full_stalls;   /* reader found the ring full */
+    unsigned long long empty_stalls;  /* simulator found the ring empty */
+    double avg_occupancy;             /* batches queued when one is taken */
+} pipeline_stats_t;
+
+/*
+ * pipelineStart - Start a producer thread reading from reader, which
+ *                 must not be used by anyone else until pipelineStop().
+ *                 Returns NULL and sets errno on failure.
+ */
+pipeline_t* pipelineStart(trace_reader_t* reader);
+
+/*
+ * pipelineNext - Return the next batch and store its size in *n, or NULL
+ *                at the end of the trace. The batch stays valid until the
+ *                next call.
+ */
+const trace_rec_t* pipelineNext(pipeline_t* pl, size_t* n);
+
+/* pipelineStop - Join the producer, fill in stats if not NULL and free */
+void pipelineStop(pipeline_t* pl, pipeline_stats_t* stats);
+
+#endif /* CACHELAB_PIPELINE_H */
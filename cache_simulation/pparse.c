@@ -0,0 +1,224 @@
+/*
+ * pparse.c - Parallel parsing of mapped text traces
+ *
+ * Chunk k covers the text from the first line that starts at or after
+ * offset k * PPARSE_CHUNK, so every worker can find its own boundaries
+ * without coordinating with its neighbours.  Chunk k is parsed into
+ * slot k % nslots; a worker only claims a slot once the reader has
+ * consumed the chunk nslots before it, which keeps the workers at most
+ * nslots chunks ahead of the simulation.
+ */
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+
+#include "pparse.h"
+
+#define SLOT_FREE  0
+#define SLOT_BUSY  1
+#define SLOT_READY 2
+
+typedef struct pparse_slot {
+    size_t chunk;           /* chunk the slot holds or is waiting for */
+    int state;
+    trace_rec_t* recs;
+    size_t n, cap;
+} pparse_slot_t;
+
+struct pparse {
+    trace_decode_t decode;
+    const char* text;
+    const char* end;
+    size_t nchunks;
+    size_t next_chunk;      /* next chunk a worker will take */
+    size_t cur;             /* chunk being handed out by pparseRead() */
+    size_t off;             /* records of cur already handed out */
+    int err;
+    int stop;
+
+    pthread_mutex_t lock;
+    pthread_cond_t changed;
+    int nthreads;
+    pthread_t* threads;
+    int nslots;
+    pparse_slot_t* slots;
+};
+
+/* chunkStart - start of chunk k: the first line starting at or after
+ * its nominal offset
+ */
+static const char* chunkStart(const pparse_t* pp, size_t k)
+{
+    const char* p;
+
+    if (k == 0)
+        return pp->text;
+    if (k >= pp->nchunks)
+        return pp->end;
+    p = pp->text + k * (size_t)PPARSE_CHUNK - 1;
+    return (const char*)memchr(p, '\n', pp->end - p) + 1;
+}
+
+/* parseChunk - parse chunk k into slot, allocating its record array on
+ * first use and growing it as needed. Returns an errno value.
+ */
+static int parseChunk(pparse_t* pp, size_t k, pparse_slot_t* slot)
+{
+    const char* p = chunkStart(pp, k);
+    const char* end = chunkStart(pp, k + 1);
+    mem_addr_t state = 0;
+
+    if (slot->recs == NULL) {
+        /* Lackey lines are rarely shorter than 12 bytes */
+        slot->recs = (trace_rec_t*)malloc(PPARSE_CHUNK / 12 * sizeof(trace_rec_t));
+        if (slot->recs == NULL)
+            return ENOMEM;
+        slot->cap = PPARSE_CHUNK / 12;
+    }
+    slot->n = 0;
+    for (;;) {
+        slot->n += pp->decode(p, end, slot->recs + slot->n,
+                              slot->cap - slot->n, &p, &state);
+        if (p == end)
+            return 0;
+        trace_rec_t* recs = (trace_rec_t*)realloc(slot->recs,
+                                                  2 * slot->cap * sizeof(trace_rec_t));
+        if (recs == NULL)
+            return ENOMEM;
+        slot->recs = recs;
+        slot->cap *= 2;
+    }
+}
+
+static void* pparseMain(void* arg)
+{
+    pparse_t* pp = (pparse_t*)arg;
+
+    pthread_mutex_lock(&pp->lock);
+    while (!pp->stop && pp->next_chunk < pp->nchunks) {
+        size_t k = pp->next_chunk++;
+        pparse_slot_t* slot = &pp->slots[k % pp->nslots];
+
+        while (!pp->stop && (slot->chunk != k || slot->state != SLOT_FREE))
+            pthread_cond_wait(&pp->changed, &pp->lock);
+        if (pp->stop)
+            break;
+        slot->state = SLOT_BUSY;
+        pthread_mutex_unlock(&pp->lock);
+
+        int err = parseChunk(pp, k, slot);
+
+        pthread_mutex_lock(&pp->lock);
+        if (err != 0 && pp->err == 0)
+            pp->err = err;
+        slot->state = SLOT_READY;
+        pthread_cond_broadcast(&pp->changed);
+    }
+    pthread_mutex_unlock(&pp->lock);
+    return NULL;
+}
+
+pparse_t* pparseStart(trace_decode_t decode, const char* text,
+                      const char* end, int threads)
+{
+    pparse_t* pp = (pparse_t*)calloc(1, sizeof(pparse_t));
+
+    if (pp == NULL)
+        return NULL;
+    pp->decode = decode;
+    pp->text = text;
+    pp->end = end;
+    pp->nchunks = ((size_t)(end - text) + PPARSE_CHUNK - 1) / PPARSE_CHUNK;
+    pthread_mutex_init(&pp->lock, NULL);
+    pthread_cond_init(&pp->changed, NULL);
+
+    /* More workers than chunks would only hold slots */
+    if ((size_t)threads > pp->nchunks)
+        threads = (int)pp->nchunks;
+    pp->nslots = 2 * threads;
+    pp->slots = (pparse_slot_t*)calloc(pp->nslots, sizeof(pparse_slot_t));
+    pp->threads = (pthread_t*)calloc(threads, sizeof(pthread_t));
+    if (pp->slots == NULL || pp->threads == NULL)
+        goto nomem;
+    /* Record arrays are allocated by the first chunk parsed into them */
+    for (int i = 0; i < pp->nslots; i++)
+        pp->slots[i].chunk = i;
+    for (int i = 0; i < threads; i++) {
+        int err = pthread_create(&pp->threads[i], NULL, pparseMain, pp);
+        if (err != 0) {
+            pparseStop(pp);
+            errno = err;
+            return NULL;
+        }
+        pp->nthreads++;
+    }
+    return pp;
+
+nomem:
+    pparseStop(pp);
+    errno = ENOMEM;
+    return NULL;
+}
+
+size_t pparseRead(pparse_t* pp, trace_rec_t* recs, size_t max)
+{
+    size_t n = 0;
+
+    while (n < max && pp->cur < pp->nchunks) {
+        pparse_slot_t* slot = &pp->slots[pp->cur % pp->nslots];
+
+        pthread_mutex_lock(&pp->lock);
+        while (pp->err == 0 && (slot->chunk != pp->cur || slot->state != SLOT_READY))
+            pthread_cond_wait(&pp->changed, &pp->lock);
+        int err = pp->err;
+        pthread_mutex_unlock(&pp->lock);
+        if (err != 0) {
+            errno = err;
+            return (size_t)-1;
+        }
+
+        /* A ready slot is not touched by the workers until freed */
+        size_t take = slot->n - pp->off;
+        if (take > max - n)
+            take = max - n;
+        memcpy(recs + n, slot->recs + pp->off, take * sizeof(trace_rec_t));
+        n += take;
+        pp->off += take;
+
+        if (pp->off == slot->n) {
+            pthread_mutex_lock(&pp->lock);
+            slot->chunk = pp->cur + pp->nslots;
+            slot->state = SLOT_FREE;
+            pthread_cond_broadcast(&pp->changed);
+            pthread_mutex_unlock(&pp->lock);
+            pp->cur++;
+            pp->off = 0;
+        }
+    }
+    return n;
+}
+
+void pparseStop(pparse_t* pp)
+{
+    if (pp == NULL)
+        return;
+    pthread_mutex_lock(&pp->lock);
+    pp->stop = 1;
+    pthread_cond_broadcast(&pp->changed);
+    pthread_mutex_unlock(&pp->lock);
+    for (int i = 0; i < pp->nthreads; i++)
+        pthread_join(pp->threads[i], NULL);
+
+    if (pp->slots != NULL) {
+        for (int i = 0; i < pp->nslots; i++)
+            free(pp->slots[i].recs);
+    }
+    free(pp->slots);
+    free(pp->threads);
+    pthread_mutex_destroy(&pp->lock);
+    pthread_cond_destroy(&pp->changed);
+    free(pp);
+}
@@ -0,0 +1,40 @@
+/*
+ * pparse.h - Parallel parsing of mapped text traces
+ *
+ * The text is split at newline boundaries into fixed-size chunks that a
+ * pool of worker threads parses concurrently into record batches.  The
+ * batches are handed out strictly in chunk order, so the records come
+ * out exactly as a serial decode of the whole text would produce them.
+ */
+
+#ifndef CACHELAB_PPARSE_H
+#define CACHELAB_PPARSE_H
+
+#include "trace.h"
+
+/* Text per chunk; traces shorter than two chunks are parsed serially */
+#define PPARSE_CHUNK (4 << 20)
+
+typedef struct pparse pparse_t;
+
+/*
+ * pparseStart - Start threads workers (no more than there are chunks)
+ *               decoding [text, end) with the decoder of a text format.
+ *               The text must end in a newline and stay mapped until
+ *               pparseStop(). Returns NULL and sets errno on failure.
+ */
+pparse_t* pparseStart(trace_decode_t decode, const char* text,
+                      const char* end, int threads);
+
+/*
+ * pparseRead - Copy up to max records, in trace order, into recs.
+ *              Returns the number of records, 0 once all chunks have
+ *              been handed out, or (size_t)-1 with errno set if a
+ *              worker ran out of memory.
+ */
+size_t pparseRead(pparse_t* pp, trace_rec_t* recs, size_t max);
+
+/* pparseStop - Stop the workers and free everything */
+void pparseStop(pparse_t* pp);
+
+#endif /* CACHELAB_PPARSE_H */
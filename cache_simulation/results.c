@@ -0,0 +1,131 @@
+/*
+ * results.c - Machine-readable simulation results
+ *
+ * Rows are formatted straight into the caller's stream, so a sweep of
+ * thousands of configurations costs one fprintf per row and a flush
+ * at the end.
+ */
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include "results.h"
+
+/* CSV columns, and the keys of JSON rows */
+#define RESULTS_HEADER "trace,s,E,b,hits,misses,evictions,records,seconds,accesses_per_sec,error\n"
+
+struct results {
+    FILE* fp;
+    int csv;
+    int header;     /* the CSV header is still to be written */
+};
+
+results_t* resultsOpen(const char* format, FILE* fp)
+{
+    results_t* res;
+    int csv;
+
+    if (format != NULL && strcmp(format, "csv") == 0)
+        csv = 1;
+    else if (format != NULL && strcmp(format, "json") == 0)
+        csv = 0;
+    else {
+        errno = EINVAL;
+        return NULL;
+    }
+    res = (results_t*)malloc(sizeof(results_t));
+    if (res == NULL)
+        return NULL;
+    res->fp = fp;
+    res->csv = csv;
+    /* Pipes and terminals cannot tell; files appended to can */
+    res->header = csv && ftell(fp) <= 0;
+    return res;
+}
+
+/* writeJsonString - write str as a JSON string */
+static void writeJsonString(FILE* fp, const char* str)
+{
+    putc('"', fp);
+    for (const unsigned char* p = (const unsigned char*)str; *p != '\0'; p++) {
+        if (*p == '"' || *p == '\\')
+            fprintf(fp, "\\%c", *p);
+        else if (*p < 0x20)
+            fprintf(fp, "\\u%04x", *p);
+        else
+            putc(*p, fp);
+    }
+    putc('"', fp);
+}
+
+/* writeCsvField - write str as a CSV field, quoted if it has to be */
+static void writeCsvField(FILE* fp, const char* str)
+{
+    if (strpbrk(str, ",\"\r\n") == NULL) {
+        fputs(str, fp);
+        return;
+    }
+    putc('"', fp);
+    for (const char* p = str; *p != '\0'; p++) {
+        if (*p == '"')
+            putc('"', fp);
+        putc(*p, fp);
+    }
+    putc('"', fp);
+}
+
+int resultsWrite(results_t* res, const results_row_t* row)
+{
+    FILE* fp = res->fp;
+    unsigned long long accesses = row->accesses ? row->accesses
+                                                : row->stats.hits + row->stats.misses;
+    double rate = row->elapsed > 0 ? accesses / row->elapsed : 0;
+
+    if (res->header) {
+        fputs(RESULTS_HEADER, fp);
+        res->header = 0;
+    }
+    if (res->csv) {
+        writeCsvField(fp, row->trace);
+        fprintf(fp, ",%d,%d,%d,%llu,%llu,%llu,%llu,%.6f,%.0f,", row->s, row->E, row->b,
+                row->stats.hits, row->stats.misses, row->stats.evictions, row->records,
+                row->elapsed, rate);
+        if (row->err != 0)
+            writeCsvField(fp, strerror(row->err));
+        putc('\n', fp);
+    } else {
+        fputs("{\"trace\": ", fp);
+        writeJsonString(fp, row->trace);
+        fprintf(fp, ", \"s\": %d, \"E\": %d, \"b\": %d", row->s, row->E, row->b);
+        if (row->err != 0) {
+            fputs(", \"error\": ", fp);
+            writeJsonString(fp, strerror(row->err));
+        } else {
+            fprintf(fp, ", \"hits\": %llu, \"misses\": %llu, \"evictions\": %llu",
+                    row->stats.hits, row->stats.misses, row->stats.evictions);
+        }
+        fprintf(fp, ", \"records\": %llu, \"seconds\": %.6f, \"accesses_per_sec\": %.0f}\n",
+                row->records, row->elapsed, rate);
+    }
+    if (ferror(fp)) {
+        errno = EIO;
+        return -1;
+    }
+    return 0;
+}
+
+int resultsClose(results_t* res)
+{
+    int ret = 0;
+
+    if (fflush(res->fp) != 0)
+        ret = -1;
+    else if (ferror(res->fp)) {
+        errno = EIO;
+        ret = -1;
+    }
+    free(res);
+    return ret;
+}
@@ -0,0 +1,52 @@
+/*
+ * results.h - Machine-readable simulation results
+ *
+ * A results sink writes one row per simulated configuration to a
+ * stream, as JSON lines or CSV: the trace, s, E and b, the 64-bit
+ * hits, misses and evictions, the trace records replayed, the wall time
+ * and the simulated accesses (hits plus misses) per second. Unlike
+ * printSummary(), nothing is truncated to int and no file is rewritten
+ * per run, so rows of many runs can go to one stream.
+ */
+
+#ifndef CACHELAB_RESULTS_H
+#define CACHELAB_RESULTS_H
+
+#include <stdio.h>
+
+#include "cache.h"
+
+/* Type: One row of results */
+typedef struct results_row {
+    const char* trace;
+    int s, E, b;
+    cache_stats_t stats;
+    unsigned long long records;     /* trace records replayed */
+    double elapsed;                 /* wall seconds; for rows of one pass
+                                     * or sweep, that of the whole of it */
+    unsigned long long accesses;    /* accesses simulated in elapsed, if
+                                     * not just these hits and misses */
+    int err;                        /* errno if the configuration failed */
+} results_row_t;
+
+typedef struct results results_t;
+
+/*
+ * resultsOpen - Start writing rows to fp in format "json" (an object
+ *               per line) or "csv" (a header line first, unless fp
+ *               already has something in it). fp stays the caller's.
+ *               Returns NULL and sets errno (EINVAL for an unknown
+ *               format) on failure.
+ */
+results_t* resultsOpen(const char* format, FILE* fp);
+
+/* resultsWrite - Write a row. Returns -1 and sets errno on failure. */
+int resultsWrite(results_t* res, const results_row_t* row);
+
+/*
+ * resultsClose - Flush the rows and free the sink. Returns -1 and sets
+ *                errno if a row could not be written.
+ */
+int resultsClose(results_t* res);
+
+#endif /* CACHELAB_RESULTS_H */
@@ -0,0 +1,247 @@
+/*
+ * shard.c - Set-partitioned parallel simulation
+ *
+ * The sets of slice j of 2^L are exactly a cache of s - L set bits and
+ * b + L block bits that only sees the records of slice j, so every
+ * thread simulates an ordinary cache of its own. Records reach it
+ * through a single-producer/single-consumer ring of batches, indexed
+ * like the pipeline's by two free-running counters on separate cache
+ * lines. The router fills the batch at head in place and publishes it
+ * once it is full, or when the trace ends. A worker that has spun for a
+ * while without work parks on a condition variable, so a simulation
+ * kept open between accesses costs no CPU; the router only takes the
+ * lock to wake a worker that is parked.
+ */
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdlib.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+
+#include "shard.h"
+
+#define CACHE_LINE 64
+#define SPIN_LIMIT 256
+
+typedef struct shard_worker {
+    cache_t* cache;
+    pthread_t thread;
+    trace_rec_t (*batches)[TRACE_BATCH];
+    size_t counts[SHARD_SLOTS];
+
+    /* Router side */
+    size_t head __attribute__((aligned(CACHE_LINE)));
+    size_t fill;                /* records in the batch at head */
+    int done;                   /* head will not move again */
+
+    /* Worker side */
+    size_t tail __attribute__((aligned(CACHE_LINE)));
+    int parked;                 /* waiting on wake for head or done */
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+} shard_worker_t;
+
+struct shard {
+    int b;
+    unsigned int nworkers;
+    shard_worker_t* workers;
+};
+
+/* backoff - wait a little longer each time a side finds nothing to do */
+static void backoff(unsigned int* spins)
+{
+    if (++*spins < SPIN_LIMIT)
+        __builtin_ia32_pause();
+    else
+        sched_yield();
+}
+
+/* idle - whether the worker has nothing to do yet; done is published
+ * after the last head, so it is checked first
+ */
+static int idle(shard_worker_t* w, size_t tail, size_t* head)
+{
+    int done = __atomic_load_n(&w->done, __ATOMIC_SEQ_CST);
+
+    *head = __atomic_load_n(&w->head, __ATOMIC_SEQ_CST);
+    return *head == tail && !done;
+}
+
+/* park - sleep until the router publishes a batch or sets done. parked
+ * is set before head and done are checked again, and the router stores
+ * those before it checks parked, so one of the two sees the other.
+ */
+static void park(shard_worker_t* w, size_t tail)
+{
+    size_t head;
+
+    pthread_mutex_lock(&w->lock);
+    __atomic_store_n(&w->parked, 1, __ATOMIC_SEQ_CST);
+    while (idle(w, tail, &head))
+        pthread_cond_wait(&w->wake, &w->lock);
+    __atomic_store_n(&w->parked, 0, __ATOMIC_RELAXED);
+    pthread_mutex_unlock(&w->lock);
+}
+
+/* wake - wake the worker if it is parked */
+static void wake(shard_worker_t* w)
+{
+    if (!__atomic_load_n(&w->parked, __ATOMIC_SEQ_CST))
+        return;
+    pthread_mutex_lock(&w->lock);
+    pthread_cond_signal(&w->wake);
+    pthread_mutex_unlock(&w->lock);
+}
+
+static void* shardMain(void* arg)
+{
+    shard_worker_t* w = (shard_worker_t*)arg;
+    size_t tail = w->tail;
+
+    for (;;) {
+        unsigned int spins = 0;
+        size_t head;
+
+        while (idle(w, tail, &head)) {
+            if (spins < SPIN_LIMIT)
+                backoff(&spins);
+            else
+                park(w, tail);
+        }
+        if (head == tail)
+            return NULL;
+        for (; tail != head; tail++) {
+            cacheReplay(w->cache, w->batches[tail % SHARD_SLOTS],
+                        w->counts[tail % SHARD_SLOTS]);
+            __atomic_store_n(&w->tail, tail + 1, __ATOMIC_RELEASE);
+        }
+    }
+}
+
+/* publish - hand the batch at head to the worker */
+static void publish(shard_worker_t* w)
+{
+    w->counts[w->head % SHARD_SLOTS] = w->fill;
+    w->fill = 0;
+    __atomic_store_n(&w->head, w->head + 1, __ATOMIC_SEQ_CST);
+    wake(w);
+}
+
+/* claim - wait until the batch at head is free to fill */
+static void claim(shard_worker_t* w)
+{
+    unsigned int spins = 0;
+
+    while (w->head - __atomic_load_n(&w->tail, __ATOMIC_ACQUIRE) == SHARD_SLOTS)
+        backoff(&spins);
+}
+
+shard_t* shardStart(int s, int E, int b, int flags, int threads)
+{
+    shard_t* sh = (shard_t*)calloc(1, sizeof(shard_t));
+    int bits = 0, err = 0;
+
+    if (sh == NULL)
+        return NULL;
+    while (bits < s && (2 << bits) <= threads)
+        bits++;
+    sh->b = b;
+    if (posix_memalign((void**)&sh->workers, CACHE_LINE,
+                       ((size_t)1 << bits) * sizeof(shard_worker_t)) != 0) {
+        free(sh);
+        errno = ENOMEM;
+        return NULL;
+    }
+    for (unsigned int i = 0; i < (1U << bits); i++) {
+        shard_worker_t* w = &sh->workers[i];
+
+        *w = (shard_worker_t){ 0 };
+        pthread_mutex_init(&w->lock, NULL);
+        pthread_cond_init(&w->wake, NULL);
+        w->batches = malloc(SHARD_SLOTS * sizeof(*w->batches));
+        w->cache = cacheCreate(s - bits, E, b + bits, flags);
+        if (w->batches == NULL || w->cache == NULL)
+            err = w->batches == NULL ? ENOMEM : errno;
+        else
+            err = pthread_create(&w->thread, NULL, shardMain, w);
+        if (err != 0) {
+            cacheFree(w->cache);
+            free(w->batches);
+            pthread_cond_destroy(&w->wake);
+            pthread_mutex_destroy(&w->lock);
+            break;
+        }
+        sh->nworkers++;
+    }
+    if (err != 0) {
+        shardStop(sh, NULL);
+        errno = err;
+        return NULL;
+    }
+    return sh;
+}
+
+void shardReplay(shard_t* sh, const trace_rec_t* recs, size_t n)
+{
+    const mem_addr_t mask = sh->nworkers - 1;
+    const int b = sh->b;
+
+    for (size_t i = 0; i < n; i++) {
+        shard_worker_t* w = &sh->workers[(recs[i].addr >> b) & mask];
+
+        if (w->fill == 0)
+            claim(w);
+        w->batches[w->head % SHARD_SLOTS][w->fill++] = recs[i];
+        if (w->fill == TRACE_BATCH)
+            publish(w);
+    }
+}
+
+void shardStats(shard_t* sh, cache_stats_t* stats)
+{
+    *stats = (cache_stats_t){ 0 };
+    for (unsigned int i = 0; i < sh->nworkers; i++) {
+        shard_worker_t* w = &sh->workers[i];
+        unsigned int spins = 0;
+        cache_stats_t part;
+
+        if (w->fill > 0)
+            publish(w);
+        /* Idle until the next publish, so its cache is ours to read */
+        while (__atomic_load_n(&w->tail, __ATOMIC_ACQUIRE) != w->head)
+            backoff(&spins);
+        cacheStats(w->cache, &part);
+        stats->hits += part.hits;
+        stats->misses += part.misses;
+        stats->evictions += part.evictions;
+    }
+}
+
+void shardStop(shard_t* sh, cache_stats_t* stats)
+{
+    if (stats != NULL)
+        *stats = (cache_stats_t){ 0 };
+    for (unsigned int i = 0; i < sh->nworkers; i++) {
+        shard_worker_t* w = &sh->workers[i];
+        cache_stats_t part;
+
+        if (w->fill > 0)
+            publish(w);
+        __atomic_store_n(&w->done, 1, __ATOMIC_SEQ_CST);
+        wake(w);
+        pthread_join(w->thread, NULL);
+        if (stats != NULL) {
+            cacheStats(w->cache, &part);
+            stats->hits += part.hits;
+            stats->misses += part.misses;
+            stats->evictions += part.evictions;
+        }
+        cacheFree(w->cache);
+        free(w->batches);
+        pthread_cond_destroy(&w->wake);
+        pthread_mutex_destroy(&w->lock);
+    }
+    free(sh->workers);
+    free(sh);
+}
@@ -0,0 +1,45 @@
+/*
+ * shard.h - Set-partitioned parallel simulation
+ *
+ * Under LRU every set evolves on its own, so one cache can be simulated
+ * by several threads at once, each owning the sets whose index is its
+ * own number modulo the thread count. The caller routes each record to
+ * the thread owning its set; each thread replays its records in trace
+ * order against its slice of the cache with private counters, and the
+ * counts add up to exactly those of a serial run.
+ */
+
+#ifndef CACHELAB_SHARD_H
+#define CACHELAB_SHARD_H
+
+#include "cache.h"
+#include "trace.h"
+
+/* Batches queued per thread */
+#define SHARD_SLOTS 16
+
+typedef struct shard shard_t;
+
+/*
+ * shardStart - Start simulating a cache like cacheCreate() does, on
+ *              threads threads, rounded down to a power of two and to at
+ *              most 2^s. Returns NULL and sets errno on failure.
+ */
+shard_t* shardStart(int s, int E, int b, int flags, int threads);
+
+/* shardReplay - Hand n trace records to the threads owning their sets */
+void shardReplay(shard_t* sh, const trace_rec_t* recs, size_t n);
+
+/*
+ * shardStats - Wait for the threads to replay everything handed to them
+ *              so far and add up their counts in stats
+ */
+void shardStats(shard_t* sh, cache_stats_t* stats);
+
+/*
+ * shardStop - Wait for the threads to replay everything handed to them,
+ *             add up their counts in stats and free everything
+ */
+void shardStop(shard_t* sh, cache_stats_t* stats);
+
+#endif /* CACHELAB_SHARD_H */
@@ -0,0 +1,283 @@
+/*
+ * stackdist.c - LRU stack distances in one pass over a trace
+ *
+ * Every access gets a time, and a hash table maps each block to the
+ * time of its last access. A Fenwick tree over the times has a one at
+ * the last access time of every block, so the distance of an access is
+ * the sum over the times after its block's previous access. The access
+ * then moves its block's one to the current time.
+ *
+ * Times only ever grow, while the live ones number no more than the
+ * distinct blocks. When the times run out, the live ones are renumbered
+ * 1, 2, ... in order, which keeps every distance intact; the tree
+ * doubles whenever that leaves it more than half full.
+ */
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include "stackdist.h"
+
+#define MIN_TIMES (1 << 16)
+#define MIN_SLOTS_LOG 10
+#define MIN_SLOTS (1 << MIN_SLOTS_LOG)
+#define MIN_HIST  (1 << 10)
+#define NO_TIME   ((size_t)-1)
+
+typedef struct stackdist_entry {
+    mem_addr_t block;
+    size_t time;            /* NO_TIME if the slot is empty */
+} stackdist_entry_t;
+
+struct stackdist {
+    int b;
+    unsigned long long accesses;
+
+    /* Fenwick tree over times 1..ntimes, plus which times are live */
+    unsigned int* tree;
+    unsigned char* live;
+    size_t ntimes;
+    size_t now;             /* times used so far */
+
+    /* Block -> last access time, linear probing */
+    stackdist_entry_t* table;
+    size_t nslots;
+    int slot_shift;         /* 64 - log2(nslots) */
+    size_t nblocks;
+
+    unsigned long long* hist;
+    size_t hist_len;        /* distances seen: 0 .. hist_len - 1 */
+    size_t hist_cap;
+};
+
+/* slotOf - home slot of a block (Fibonacci hashing) */
+static size_t slotOf(const stackdist_t* sd, mem_addr_t block)
+{
+    return (size_t)((block * 0x9e3779b97f4a7c15ULL) >> sd->slot_shift);
+}
+
+/* treeAdd - add delta at time t (1-based) */
+static void treeAdd(stackdist_t* sd, size_t t, unsigned int delta)
+{
+    for (; t <= sd->ntimes; t += t & -t)
+        sd->tree[t - 1] += delta;
+}
+
+/* treeSum - sum over times 1..t */
+static size_t treeSum(const stackdist_t* sd, size_t t)
+{
+    size_t sum = 0;
+
+    for (; t > 0; t -= t & -t)
+        sum += sd->tree[t - 1];
+    return sum;
+}
+
+/* growTable - double the hash table */
+static int growTable(stackdist_t* sd)
+{
+    stackdist_entry_t* old = sd->table;
+    size_t nold = sd->nslots;
+    stackdist_entry_t* table = (stackdist_entry_t*)malloc(2 * nold * sizeof(stackdist_entry_t));
+
+    if (table == NULL)
+        return -1;
+    sd->table = table;
+    sd->nslots = 2 * nold;
+    sd->slot_shift--;
+    for (size_t i = 0; i < sd->nslots; i++)
+        sd->table[i].time = NO_TIME;
+    for (size_t i = 0; i < nold; i++) {
+        if (old[i].time == NO_TIME)
+            continue;
+        size_t j = slotOf(sd, old[i].block);
+        while (sd->table[j].time != NO_TIME)
+            j = (j + 1) & (sd->nslots - 1);
+        sd->table[j] = old[i];
+    }
+    free(old);
+    return 0;
+}
+
+/* renumber - number the live times 1, 2, ... in order, growing the tree
+ * if they would fill more than half of it
+ */
+static int renumber(stackdist_t* sd)
+{
+    size_t ntimes = sd->ntimes;
+    size_t* rank;
+
+    if (2 * sd->nblocks > ntimes)
+        ntimes *= 2;
+    rank = (size_t*)malloc((sd->ntimes + 1) * sizeof(size_t));
+    if (rank == NULL)
+        return -1;
+    if (ntimes != sd->ntimes) {
+        unsigned int* tree = (unsigned int*)realloc(sd->tree, ntimes * sizeof(unsigned int));
+        unsigned char* live;
+
+        if (tree == NULL) {
+            free(rank);
+            return -1;
+        }
+        sd->tree = tree;
+        live = (unsigned char*)realloc(sd->live, ntimes + 1);
+        if (live == NULL) {
+            free(rank);
+            return -1;
+        }
+        sd->live = live;
+    }
+
+    rank[0] = 0;
+    for (size_t t = 1; t <= sd->now; t++)
+        rank[t] = rank[t - 1] + sd->live[t];
+    for (size_t i = 0; i < sd->nslots; i++) {
+        if (sd->table[i].time != NO_TIME)
+            sd->table[i].time = rank[sd->table[i].time];
+    }
+    free(rank);
+
+    /* Times 1..nblocks are live now; build the tree bottom up */
+    sd->ntimes = ntimes;
+    sd->now = sd->nblocks;
+    memset(sd->live, 0, ntimes + 1);
+    memset(sd->live + 1, 1, sd->nblocks);
+    for (size_t t = 1; t <= ntimes; t++)
+        sd->tree[t - 1] = sd->live[t];
+    for (size_t t = 1; t <= ntimes; t++) {
+        size_t up = t + (t & -t);
+        if (up <= ntimes)
+            sd->tree[up - 1] += sd->tree[t - 1];
+    }
+    return 0;
+}
+
+/* count - add one access at distance d to the histogram */
+static int count(stackdist_t* sd, size_t d)
+{
+    if (d >= sd->hist_cap) {
+        size_t cap = sd->hist_cap;
+        unsigned long long* hist;
+
+        while (cap <= d)
+            cap *= 2;
+        hist = (unsigned long long*)realloc(sd->hist, cap * sizeof(unsigned long long));
+        if (hist == NULL)
+            return -1;
+        memset(hist + sd->hist_cap, 0, (cap - sd->hist_cap) * sizeof(unsigned long long));
+        sd->hist = hist;
+        sd->hist_cap = cap;
+    }
+    sd->hist[d]++;
+    if (d >= sd->hist_len)
+        sd->hist_len = d + 1;
+    return 0;
+}
+
+stackdist_t* stackdistCreate(int b)
+{
+    stackdist_t* sd = (stackdist_t*)calloc(1, sizeof(stackdist_t));
+
+    if (sd == NULL)
+        return NULL;
+    sd->b = b;
+    sd->ntimes = MIN_TIMES;
+    sd->tree = (unsigned int*)calloc(sd->ntimes, sizeof(unsigned int));
+    sd->live = (unsigned char*)calloc(sd->ntimes + 1, 1);
+    sd->nslots = MIN_SLOTS;
+    sd->slot_shift = 64 - MIN_SLOTS_LOG;
+    sd->table = (stackdist_entry_t*)malloc(sd->nslots * sizeof(stackdist_entry_t));
+    sd->hist_cap = MIN_HIST;
+    sd->hist = (unsigned long long*)calloc(sd->hist_cap, sizeof(unsigned long long));
+    if (sd->tree == NULL || sd->live == NULL || sd->table == NULL || sd->hist == NULL) {
+        stackdistFree(sd);
+        errno = ENOMEM;
+        return NULL;
+    }
+    for (size_t i = 0; i < sd->nslots; i++)
+        sd->table[i].time = NO_TIME;
+    return sd;
+}
+
+int stackdistAccess(stackdist_t* sd, mem_addr_t addr)
+{
+    mem_addr_t block = addr >> sd->b;
+    size_t i;
+
+    if (sd->now == sd->ntimes && renumber(sd) != 0)
+        goto nomem;
+
+    i = slotOf(sd, block);
+    while (sd->table[i].time != NO_TIME && sd->table[i].block != block)
+        i = (i + 1) & (sd->nslots - 1);
+
+    if (sd->table[i].time != NO_TIME) {
+        size_t prev = sd->table[i].time;
+
+        if (prev == sd->now) {
+            /* Used last, as by the second half of an M: nothing moves */
+            if (count(sd, 0) != 0)
+                goto nomem;
+            sd->accesses++;
+            return 0;
+        }
+        /* Blocks whose last access came after this block's; every
+         * block's time is at most now
+         */
+        if (count(sd, sd->nblocks - treeSum(sd, prev)) != 0)
+            goto nomem;
+        treeAdd(sd, prev, -1U);
+        sd->live[prev] = 0;
+    } else {
+        /* A new block: keep the table at most half full */
+        if (2 * (sd->nblocks + 1) > sd->nslots) {
+            if (growTable(sd) != 0)
+                goto nomem;
+            i = slotOf(sd, block);
+            while (sd->table[i].time != NO_TIME)
+                i = (i + 1) & (sd->nslots - 1);
+        }
+        sd->table[i].block = block;
+        sd->nblocks++;
+    }
+
+    sd->table[i].time = ++sd->now;
+    sd->live[sd->now] = 1;
+    treeAdd(sd, sd->now, 1);
+    sd->accesses++;
+    return 0;
+
+nomem:
+    errno = ENOMEM;
+    return -1;
+}
+
+unsigned long long stackdistAccesses(const stackdist_t* sd)
+{
+    return sd->accesses;
+}
+
+unsigned long long stackdistBlocks(const stackdist_t* sd)
+{
+    return sd->nblocks;
+}
+
+size_t stackdistHistogram(const stackdist_t* sd, const unsigned long long** hist)
+{
+    *hist = sd->hist;
+    return sd->hist_len;
+}
+
+void stackdistFree(stackdist_t* sd)
+{
+    if (sd == NULL)
+        return;
+    free(sd->tree);
+    free(sd->live);
+    free(sd->table);
+    free(sd->hist);
+    free(sd);
+}
@@ -0,0 +1,51 @@
+/*
+ * stackdist.h - LRU stack distances in one pass over a trace
+ *
+ * The stack distance of an access is the number of other blocks used
+ * since the previous access to its block. An access hits in a
+ * fully-associative LRU cache of C lines exactly when its distance is
+ * below C, so one histogram of distances gives the miss count of every
+ * capacity at once. Each access costs O(log n) in the number of
+ * distinct blocks.
+ */
+
+#ifndef CACHELAB_STACKDIST_H
+#define CACHELAB_STACKDIST_H
+
+#include "trace.h"
+
+typedef struct stackdist stackdist_t;
+
+/*
+ * stackdistCreate - Start measuring the distances of accesses to blocks
+ *                   of 2^b bytes. Returns NULL and sets errno on failure.
+ */
+stackdist_t* stackdistCreate(int b);
+
+/*
+ * stackdistAccess - Record an access to addr. Returns 0, or -1 with
+ *                   errno set if there is no memory to track it.
+ */
+int stackdistAccess(stackdist_t* sd, mem_addr_t addr);
+
+/* stackdistAccesses - Number of accesses recorded */
+unsigned long long stackdistAccesses(const stackdist_t* sd);
+
+/*
+ * stackdistBlocks - Number of distinct blocks accessed, which is the
+ *                   number of compulsory misses
+ */
+unsigned long long stackdistBlocks(const stackdist_t* sd);
+
+/*
+ * stackdistHistogram - Store the histogram of finite stack distances in
+ *                      *hist: (*hist)[d] accesses had distance d. Returns
+ *                      its length, one more than the largest distance.
+ *                      The histogram stays valid until the next access.
+ */
+size_t stackdistHistogram(const stackdist_t* sd, const unsigned long long** hist);
+
+/* stackdistFree - Free everything */
+void stackdistFree(stackdist_t* sd);
+
+#endif /* CACHELAB_STACKDIST_H */
@@ -0,0 +1,552 @@
+/*
+ * sweep.c - Parameter sweeps
+ *
+ * Every worker has a deque of jobs. It takes its own jobs from the
+ * bottom and, when it runs out, steals from the top of another's. The
+ * configurations are dealt out most expensive first, so the jobs left
+ * to steal at the end are the small ones.
+ *
+ * A job simulates one slice of a configuration's sets: those whose index
+ * is slice modulo nslices, nslices being a power of two. Sets evolve
+ * independently under LRU, and the accesses to the sets of a slice are
+ * exactly the accesses to a cache of s - log2(nslices) set bits and
+ * b + log2(nslices) block bits, so a slice needs no support from the
+ * engine beyond picking out its records. A worker that takes a long job
+ * while others are idle, or fewer jobs are left than workers, halves it
+ * and leaves the other half for them, so a few expensive configurations
+ * do not keep the sweep waiting.
+ *
+ * Jobs take milliseconds at least, so a mutex per deque costs nothing
+ * measurable.
+ */
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "lockstep.h"
+#include "sweep.h"
+
+/* Largest grid a sweep takes */
+#define SWEEP_MAX_CONFIGS (1 << 20)
+
+/* Fewest records worth splitting a job over, and the most slices */
+#define SPLIT_MIN_RECS (1 << 16)
+#define SPLIT_MAX_SLICES 64
+
+/* Largest cache, in lines, run in lockstep: beyond it the lookups miss
+ * the host's caches and the loop overhead saved no longer shows
+ */
+#define LOCKSTEP_MAX_LINES (1 << 13)
+
+/* Type: Values of one key of the grid */
+typedef struct sweep_list {
+    int* vals;
+    size_t n, cap;
+    int given;      /* the spec named the key */
+} sweep_list_t;
+
+/* Type: The sets of a configuration that are congruent to slice, or
+ * with lanes set, the configurations group[config] to
+ * group[config + lanes - 1] in lockstep
+ */
+typedef struct sweep_job {
+    unsigned int config;
+    unsigned int slice, nslices;
+    unsigned int lanes;
+} sweep_job_t;
+
+/* Type: Jobs of one worker, those in [top, bottom) of jobs */
+typedef struct sweep_deque {
+    pthread_mutex_t lock;
+    sweep_job_t* jobs;
+    size_t top, bottom, cap;
+} sweep_deque_t;
+
+typedef struct sweep sweep_t;
+
+typedef struct sweep_worker {
+    sweep_t* sw;
+    int id;
+    pthread_t thread;
+    sweep_deque_t deque;
+    sweep_worker_stats_t stats;
+} sweep_worker_t;
+
+struct sweep {
+    sweep_config_t* configs;
+    const trace_rec_t* recs;
+    size_t nrecs;
+    unsigned int* group;    /* configurations run in lockstep, by job */
+    sweep_worker_t* workers;
+    int nworkers;
+    size_t pending;     /* jobs not finished yet */
+    int idle;           /* workers looking for a job */
+};
+
+/* listAdd - append a value to a list */
+static int listAdd(sweep_list_t* list, int val)
+{
+    if (list->n == list->cap) {
+        size_t cap = list->cap ? 2 * list->cap : 16;
+        int* vals = (int*)realloc(list->vals, cap * sizeof(int));
+
+        if (vals == NULL)
+            return -1;
+        list->vals = vals;
+        list->cap = cap;
+    }
+    list->vals[list->n++] = val;
+    return 0;
+}
+
+/* parseLists - split the spec into the value lists of s, E and b */
+static int parseLists(const char* p, sweep_list_t lists[3])
+{
+    static const char keys[] = "sEb";
+    sweep_list_t* list = NULL;
+
+    while (*p != '\0') {
+        const char* key = strchr(keys, *p);
+        char* end;
+        long lo, hi;
+
+        if (key != NULL && p[1] == '=') {
+            list = &lists[key - keys];
+            if (list->given)
+                return -1;
+            list->given = 1;
+            p += 2;
+        }
+        if (list == NULL)
+            return -1;
+        lo = strtol(p, &end, 10);
+        if (end == p)
+            return -1;
+        hi = lo;
+        p = end;
+        if (p[0] == '.' && p[1] == '.') {
+            hi = strtol(p + 2, &end, 10);
+            if (end == p + 2)
+                return -1;
+            p = end;
+        }
+        if (lo < 0 || hi < lo || hi > INT_MAX || hi - lo >= SWEEP_MAX_CONFIGS)
+            return -1;
+        for (long v = lo; v <= hi; v++) {
+            if (listAdd(list, (int)v) != 0)
+                return -2;
+        }
+        if (*p == ',' && p[1] != '\0')
+            p++;
+        else if (*p != '\0')
+            return -1;
+    }
+    return 0;
+}
+
+size_t sweepParse(const char* spec, int s, int E, int b, sweep_config_t** configs)
+{
+    sweep_list_t lists[3];
+    int defaults[3] = { s, E, b };
+    size_t n = 1;
+    int err = 0;
+
+    *configs = NULL;
+    memset(lists, 0, sizeof(lists));
+    switch (parseLists(spec, lists)) {
+    case -1:
+        err = EINVAL;
+        goto out;
+    case -2:
+        err = ENOMEM;
+        goto out;
+    }
+    for (int k = 0; k < 3; k++) {
+        if (!lists[k].given && defaults[k] < 0) {
+            err = EINVAL;
+            goto out;
+        }
+        if (!lists[k].given && listAdd(&lists[k], defaults[k]) != 0) {
+            err = ENOMEM;
+            goto out;
+        }
+        if (lists[k].n > SWEEP_MAX_CONFIGS / n) {
+            err = EINVAL;
+            goto out;
+        }
+        n *= lists[k].n;
+    }
+
+    *configs = (sweep_config_t*)calloc(n, sizeof(sweep_config_t));
+    if (*configs == NULL) {
+        err = ENOMEM;
+        goto out;
+    }
+    for (size_t i = 0; i < n; i++) {
+        sweep_config_t* config = &(*configs)[i];
+
+        config->s = lists[0].vals[i / (lists[1].n * lists[2].n)];
+        config->E = lists[1].vals[i / lists[2].n % lists[1].n];
+        config->b = lists[2].vals[i % lists[2].n];
+    }
+
+out:
+    for (int k = 0; k < 3; k++)
+        free(lists[k].vals);
+    if (err != 0) {
+        errno = err;
+        return 0;
+    }
+    return n;
+}
+
+/* now - seconds on the monotonic clock */
+static double now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* validBits - whether s and b fit a 64-bit address, checked without
+ * overflowing s + b, which sweepParse() leaves as large as INT_MAX
+ */
+static int validBits(const sweep_config_t* config)
+{
+    return config->s >= 0 && config->b >= 0 && config->s < 64 && config->b < 64 &&
+           config->s + config->b > 0 && config->s + config->b < 64;
+}
+
+/* jobCost - rough cost of a job: replaying the trace, plus setting up
+ * the lines; a lockstep group replays about four caches at a time. A
+ * configuration cacheCreate() rejects only costs the trace.
+ */
+static double jobCost(const sweep_t* sw, const sweep_job_t* job)
+{
+    const sweep_config_t* config = &sw->configs[job->config];
+
+    if (job->lanes > 0)
+        return (double)sw->nrecs * (job->lanes + 3) / 4;
+    if (!validBits(config))
+        return (double)sw->nrecs;
+    return (double)sw->nrecs + (double)config->E * ((size_t)1 << config->s);
+}
+
+/* fitsLockstep - whether a configuration is small enough to run in a
+ * lockstep group
+ */
+static int fitsLockstep(const sweep_config_t* config)
+{
+    return config->E <= LOCKSTEP_MAX_WAYS && config->E > 0 && validBits(config) &&
+           config->s < 32 && ((size_t)config->E << config->s) <= LOCKSTEP_MAX_LINES;
+}
+
+/* pushJob - add a job at the bottom of a deque */
+static int pushJob(sweep_deque_t* dq, sweep_job_t job)
+{
+    int err = 0;
+
+    pthread_mutex_lock(&dq->lock);
+    if (dq->bottom == dq->cap) {
+        if (dq->top > 0) {
+            memmove(dq->jobs, dq->jobs + dq->top, (dq->bottom - dq->top) * sizeof(sweep_job_t));
+            dq->bottom -= dq->top;
+            dq->top = 0;
+        } else {
+            size_t cap = dq->cap ? 2 * dq->cap : 64;
+            sweep_job_t* jobs = (sweep_job_t*)realloc(dq->jobs, cap * sizeof(sweep_job_t));
+
+            if (jobs == NULL) {
+                err = -1;
+                goto out;
+            }
+            dq->jobs = jobs;
+            dq->cap = cap;
+        }
+    }
+    dq->jobs[dq->bottom++] = job;
+out:
+    pthread_mutex_unlock(&dq->lock);
+    return err;
+}
+
+/* popJob - take the job at the bottom (owner) or top (thief) of a deque */
+static int popJob(sweep_deque_t* dq, int steal, sweep_job_t* job)
+{
+    int found = 0;
+
+    pthread_mutex_lock(&dq->lock);
+    if (dq->top < dq->bottom) {
+        *job = steal ? dq->jobs[dq->top++] : dq->jobs[--dq->bottom];
+        found = 1;
+    }
+    pthread_mutex_unlock(&dq->lock);
+    return found;
+}
+
+/* splitJob - while others are idle, or will be for want of jobs, hand
+ * half of a long job to them
+ */
+static void splitJob(sweep_worker_t* w, sweep_job_t* job)
+{
+    sweep_t* sw = w->sw;
+    const sweep_config_t* config = &sw->configs[job->config];
+
+    while ((__atomic_load_n(&sw->idle, __ATOMIC_RELAXED) > 0 ||
+            __atomic_load_n(&sw->pending, __ATOMIC_RELAXED) < (size_t)sw->nworkers) &&
+           sw->nrecs / job->nslices >= SPLIT_MIN_RECS &&
+           job->nslices < SPLIT_MAX_SLICES &&
+           __builtin_ctz(job->nslices) < config->s) {
+        sweep_job_t half = { job->config, job->slice + job->nslices, 2 * job->nslices, 0 };
+
+        __atomic_fetch_add(&sw->pending, 1, __ATOMIC_RELAXED);
+        if (pushJob(&w->deque, half) != 0) {
+            __atomic_fetch_sub(&sw->pending, 1, __ATOMIC_RELAXED);
+            return;     /* no room; run it whole */
+        }
+        job->nslices *= 2;
+        w->stats.splits++;
+    }
+}
+
+/* runLockstep - simulate the configurations of a lockstep group */
+static void runLockstep(sweep_t* sw, const sweep_job_t* job)
+{
+    const unsigned int* group = sw->group + job->config;
+    int s[LOCKSTEP_LANES], b[LOCKSTEP_LANES];
+    lockstep_t* ls;
+
+    for (unsigned int i = 0; i < job->lanes; i++) {
+        s[i] = sw->configs[group[i]].s;
+        b[i] = sw->configs[group[i]].b;
+    }
+    ls = lockstepCreate(job->lanes, s, sw->configs[group[0]].E, b);
+    if (ls == NULL) {
+        for (unsigned int i = 0; i < job->lanes; i++)
+            sw->configs[group[i]].err = errno;
+        return;
+    }
+    lockstepReplay(ls, sw->recs, sw->nrecs);
+    for (unsigned int i = 0; i < job->lanes; i++)
+        lockstepStats(ls, i, &sw->configs[group[i]].stats);
+    lockstepFree(ls);
+}
+
+/* runJob - simulate the sets of a job and add up their counts */
+static void runJob(sweep_t* sw, const sweep_job_t* job)
+{
+    if (job->lanes > 0) {
+        runLockstep(sw, job);
+        return;
+    }
+
+    sweep_config_t* config = &sw->configs[job->config];
+    int bits = __builtin_ctz(job->nslices);
+    cache_t* cache = cacheCreate(config->s - bits, config->E, config->b + bits, 0);
+    cache_stats_t stats;
+
+    if (cache == NULL) {
+        __atomic_store_n(&config->err, errno, __ATOMIC_RELAXED);
+        return;
+    }
+    if (job->nslices == 1) {
+        cacheReplay(cache, sw->recs, sw->nrecs);
+    } else {
+        trace_rec_t batch[TRACE_BATCH];
+        mem_addr_t mask = job->nslices - 1;
+        size_t n = 0;
+
+        for (size_t i = 0; i < sw->nrecs; i++) {
+            batch[n] = sw->recs[i];
+            n += ((batch[n].addr >> config->b) & mask) == job->slice;
+            if (n == TRACE_BATCH) {
+                cacheReplay(cache, batch, n);
+                n = 0;
+            }
+        }
+        cacheReplay(cache, batch, n);
+    }
+    cacheStats(cache, &stats);
+    cacheFree(cache);
+    __atomic_fetch_add(&config->stats.hits, stats.hits, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&config->stats.misses, stats.misses, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&config->stats.evictions, stats.evictions, __ATOMIC_RELAXED);
+}
+
+/* findJob - take a job of our own, or else steal one, starting with the
+ * next worker round
+ */
+static int findJob(sweep_worker_t* w, sweep_job_t* job)
+{
+    sweep_t* sw = w->sw;
+
+    if (popJob(&w->deque, 0, job))
+        return 1;
+    for (int i = 1; i < sw->nworkers; i++) {
+        if (popJob(&sw->workers[(w->id + i) % sw->nworkers].deque, 1, job)) {
+            w->stats.steals++;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static void* sweepMain(void* arg)
+{
+    sweep_worker_t* w = (sweep_worker_t*)arg;
+    sweep_t* sw = w->sw;
+    sweep_job_t job;
+
+    while (__atomic_load_n(&sw->pending, __ATOMIC_ACQUIRE) > 0) {
+        if (!findJob(w, &job)) {
+            /* Wait for a split, or for the last jobs to finish */
+            __atomic_fetch_add(&sw->idle, 1, __ATOMIC_RELAXED);
+            while (__atomic_load_n(&sw->pending, __ATOMIC_ACQUIRE) > 0 && !findJob(w, &job))
+                sched_yield();
+            __atomic_fetch_sub(&sw->idle, 1, __ATOMIC_RELAXED);
+            if (__atomic_load_n(&sw->pending, __ATOMIC_ACQUIRE) == 0)
+                break;
+        }
+
+        double start = now();
+        splitJob(w, &job);
+        runJob(sw, &job);
+        w->stats.jobs++;
+        w->stats.busy += now() - start;
+        __atomic_fetch_sub(&sw->pending, 1, __ATOMIC_RELEASE);
+    }
+    return NULL;
+}
+
+/* Type: A job and its cost, for dealing them out */
+typedef struct sweep_order {
+    double cost;
+    sweep_job_t job;
+} sweep_order_t;
+
+/* compareCost - order jobs by descending cost */
+static int compareCost(const void* a, const void* b)
+{
+    double ca = ((const sweep_order_t*)a)->cost;
+    double cb = ((const sweep_order_t*)b)->cost;
+
+    return ca < cb ? 1 : ca > cb ? -1 : 0;
+}
+
+int sweepRun(sweep_config_t* configs, size_t n,
+             const trace_rec_t* recs, size_t nrecs, int threads,
+             sweep_stats_t* stats)
+{
+    sweep_t sw = { configs, recs, nrecs, NULL, NULL, 0, 0, 0 };
+    sweep_order_t* order = NULL;
+    size_t njobs = 0, ngrouped = 0, lanes, small = 0;
+    int started, err = 0;
+    double start = now();
+
+    if (threads <= 0)
+        threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    if ((size_t)threads > n * SPLIT_MAX_SLICES)
+        threads = (int)(n * SPLIT_MAX_SLICES);
+    if (threads < 1)
+        threads = 1;
+    sw.workers = (sweep_worker_t*)calloc(threads, sizeof(sweep_worker_t));
+    sw.group = (unsigned int*)malloc(n * sizeof(unsigned int));
+    order = (sweep_order_t*)malloc(n * sizeof(sweep_order_t));
+    if (sw.workers == NULL || sw.group == NULL || order == NULL) {
+        err = ENOMEM;
+        goto out;
+    }
+    sw.nworkers = threads;
+    for (int i = 0; i < threads; i++) {
+        sw.workers[i].sw = &sw;
+        sw.workers[i].id = i;
+        pthread_mutex_init(&sw.workers[i].deque.lock, NULL);
+    }
+
+    /* Run small configurations in lockstep groups, each of the same E,
+     * as long as that leaves every worker a job of its own
+     */
+    for (size_t i = 0; i < n; i++)
+        small += fitsLockstep(&configs[i]);
+    lanes = (small + threads - 1) / threads;
+    if (lanes > LOCKSTEP_LANES)
+        lanes = LOCKSTEP_LANES;
+    for (int ways = 1; lanes > 1 && ways <= LOCKSTEP_MAX_WAYS; ways++) {
+        sweep_job_t job = { 0, 0, 1, 0 };
+
+        for (size_t i = 0; i <= n; i++) {
+            if (job.lanes > 0 && (i == n || job.lanes == lanes)) {
+                order[njobs++].job = job;
+                job.lanes = 0;
+            }
+            if (i < n && configs[i].E == ways && fitsLockstep(&configs[i])) {
+                if (job.lanes == 0)
+                    job.config = (unsigned int)ngrouped;
+                sw.group[ngrouped++] = (unsigned int)i;
+                job.lanes++;
+            }
+        }
+    }
+    for (size_t i = 0; i < n; i++) {
+        sweep_job_t job = { (unsigned int)i, 0, 1, 0 };
+
+        if (lanes <= 1 || !fitsLockstep(&configs[i]))
+            order[njobs++].job = job;
+    }
+
+    /* Deal the jobs out round robin, the most expensive ones at the
+     * bottoms of the deques, where their owners start
+     */
+    for (size_t i = 0; i < njobs; i++)
+        order[i].cost = jobCost(&sw, &order[i].job);
+    qsort(order, njobs, sizeof(sweep_order_t), compareCost);
+    sw.pending = njobs;
+    for (size_t i = njobs; i-- > 0; ) {
+        if (pushJob(&sw.workers[i % threads].deque, order[i].job) != 0) {
+            err = ENOMEM;
+            goto out;
+        }
+    }
+
+    /* The caller is worker 0; if a thread cannot start, the others
+     * steal its jobs
+     */
+    for (started = 1; started < threads; started++) {
+        if (pthread_create(&sw.workers[started].thread, NULL, sweepMain,
+                           &sw.workers[started]) != 0)
+            break;
+    }
+    sweepMain(&sw.workers[0]);
+    for (int i = 1; i < started; i++)
+        pthread_join(sw.workers[i].thread, NULL);
+
+    if (stats != NULL) {
+        stats->workers = threads;
+        stats->elapsed = now() - start;
+        stats->worker = (sweep_worker_stats_t*)calloc(threads, sizeof(sweep_worker_stats_t));
+        for (int i = 0; stats->worker != NULL && i < threads; i++)
+            stats->worker[i] = sw.workers[i].stats;
+    }
+
+out:
+    for (int i = 0; i < sw.nworkers; i++) {
+        pthread_mutex_destroy(&sw.workers[i].deque.lock);
+        free(sw.workers[i].deque.jobs);
+    }
+    free(sw.workers);
+    free(sw.group);
+    free(order);
+    if (err != 0) {
+        errno = err;
+        return -1;
+    }
+    return 0;
+}
@@ -0,0 +1,62 @@
+/*
+ * sweep.h - Parameter sweeps
+ *
+ * A sweep simulates a grid of cache configurations over one trace that
+ * is already decoded in memory. Every configuration gets a cache of its
+ * own, so a pool of worker threads can simulate as many of them at once
+ * as there are cores, all reading the same records. Idle workers steal
+ * jobs from busy ones, so the sweep takes about as long as its total
+ * work divided by the number of cores.
+ */
+
+#ifndef CACHELAB_SWEEP_H
+#define CACHELAB_SWEEP_H
+
+#include "cache.h"
+#include "trace.h"
+
+/* Type: One configuration of a sweep and its results */
+typedef struct sweep_config {
+    int s, E, b;
+    cache_stats_t stats;
+    int err;        /* errno if the cache could not be created, else 0 */
+} sweep_config_t;
+
+/* Type: What one worker of a sweep did */
+typedef struct sweep_worker_stats {
+    unsigned long long jobs;    /* jobs run, halves of split ones included */
+    unsigned long long steals;  /* jobs taken from other workers */
+    unsigned long long splits;  /* jobs halved for idle workers */
+    double busy;                /* seconds spent running jobs */
+} sweep_worker_stats_t;
+
+/* Type: Sweep statistics */
+typedef struct sweep_stats {
+    int workers;
+    double elapsed;             /* seconds the sweep took */
+    sweep_worker_stats_t* worker;   /* one per worker; caller frees */
+} sweep_stats_t;
+
+/*
+ * sweepParse - Parse a grid like "s=1..12,E=1,2,4,8,b=3..7" into
+ *              *configs, s varying slowest and b fastest. Each key takes
+ *              a comma-separated list of values and lo..hi ranges; a key
+ *              left out has only the value given here, and must not be
+ *              left out if that is negative. Returns the number of
+ *              configurations, or 0 and sets errno (EINVAL for a bad
+ *              grid). The caller frees *configs.
+ */
+size_t sweepParse(const char* spec, int s, int E, int b, sweep_config_t** configs);
+
+/*
+ * sweepRun - Simulate each of the n configurations over the records on
+ *            up to threads threads (0: one per CPU), the caller's own
+ *            included. Long configurations are split by set across idle
+ *            threads. Fills in stats unless it is NULL. Returns 0, or -1
+ *            and sets errno if the sweep could not be set up.
+ */
+int sweepRun(sweep_config_t* configs, size_t n,
+             const trace_rec_t* recs, size_t nrecs, int threads,
+             sweep_stats_t* stats);
+
+#endif /* CACHELAB_SWEEP_H */
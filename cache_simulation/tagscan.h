@@ -0,0 +1,149 @@
+/*
+ * tagscan.h - SIMD scans over the ways of a cache set
+ *
+ * Every helper looks at all n ways of a set at once: the tags or time
+ * stamps of a set are contiguous and padded to n ways, with n a power of
+ * two from 4 to 16, and aligned to their own size. Padding ways hold a
+ * tag that never matches and a time stamp that is never the oldest.
+ *
+ * The helpers are compiled for a specific instruction set with a target
+ * attribute, so they are only inlined into functions compiled for the
+ * same one. A kernel gets them by being declared with that target and
+ * __attribute__((flatten)); csim picks a kernel at run time with
+ * __builtin_cpu_supports().
+ */
+
+#ifndef CACHELAB_TAGSCAN_H
+#define CACHELAB_TAGSCAN_H
+
+#include "trace.h"
+
+/* Tag of an empty way in a set of 32-bit tags */
+#define TAG_INVALID32 (~0U)
+
+/* Time stamp of a padding way: the largest a signed compare allows */
+#define STAMP_PAD 0x7fffffffffffffffULL
+
+#if defined(__x86_64__)
+#define TAGSCAN_SIMD 1
+
+#include <immintrin.h>
+
+/*
+ * tagMatch64Avx2 - Return a mask of the ways among n 64-bit tags that
+ *                  hold tag
+ */
+static inline __attribute__((target("avx2")))
+unsigned int tagMatch64Avx2(const mem_addr_t* tags, unsigned int n, mem_addr_t tag)
+{
+    __m256i key = _mm256_set1_epi64x((long long)tag);
+    unsigned int mask = 0;
+
+    for (unsigned int i = 0; i < n; i += 4) {
+        __m256i eq = _mm256_cmpeq_epi64(_mm256_load_si256((const __m256i*)(tags + i)), key);
+        mask |= (unsigned int)_mm256_movemask_pd(_mm256_castsi256_pd(eq)) << i;
+    }
+    return mask;
+}
+
+/* tagMatch32Avx2 - Like tagMatch64Avx2(), for 32-bit tags */
+static inline __attribute__((target("avx2")))
+unsigned int tagMatch32Avx2(const unsigned int* tags, unsigned int n, unsigned int tag)
+{
+    if (n == 4) {
+        __m128i eq = _mm_cmpeq_epi32(_mm_load_si128((const __m128i*)tags),
+                                     _mm_set1_epi32((int)tag));
+        return (unsigned int)_mm_movemask_ps(_mm_castsi128_ps(eq));
+    }
+
+    __m256i key = _mm256_set1_epi32((int)tag);
+    unsigned int mask = 0;
+
+    for (unsigned int i = 0; i < n; i += 8) {
+        __m256i eq = _mm256_cmpeq_epi32(_mm256_load_si256((const __m256i*)(tags + i)), key);
+        mask |= (unsigned int)_mm256_movemask_ps(_mm256_castsi256_ps(eq)) << i;
+    }
+    return mask;
+}
+
+/*
+ * stampOldestAvx2 - Return the first of n ways with the smallest time
+ *                   stamp. Stamps must be below 2^63.
+ */
+static inline __attribute__((target("avx2")))
+unsigned int stampOldestAvx2(const unsigned long long* stamps, unsigned int n)
+{
+    const __m256i* v = (const __m256i*)stamps;
+    __m256i min = _mm256_load_si256(v);
+
+    for (unsigned int i = 1; i < n / 4; i++) {
+        __m256i x = _mm256_load_si256(v + i);
+        min = _mm256_blendv_epi8(min, x, _mm256_cmpgt_epi64(min, x));
+    }
+    /* Spread the smallest stamp to every lane */
+    __m256i x = _mm256_permute4x64_epi64(min, _MM_SHUFFLE(1, 0, 3, 2));
+    min = _mm256_blendv_epi8(min, x, _mm256_cmpgt_epi64(min, x));
+    x = _mm256_shuffle_epi32(min, _MM_SHUFFLE(1, 0, 3, 2));
+    min = _mm256_blendv_epi8(min, x, _mm256_cmpgt_epi64(min, x));
+
+    unsigned int mask = 0;
+    for (unsigned int i = 0; i < n / 4; i++) {
+        __m256i eq = _mm256_cmpeq_epi64(_mm256_load_si256(v + i), min);
+        mask |= (unsigned int)_mm256_movemask_pd(_mm256_castsi256_pd(eq)) << (4 * i);
+    }
+    return __builtin_ctz(mask);
+}
+
+/* tagMatch64Sse4 - Like tagMatch64Avx2(), with SSE4.2 */
+static inline __attribute__((target("sse4.2")))
+unsigned int tagMatch64Sse4(const mem_addr_t* tags, unsigned int n, mem_addr_t tag)
+{
+    __m128i key = _mm_set1_epi64x((long long)tag);
+    unsigned int mask = 0;
+
+    for (unsigned int i = 0; i < n; i += 2) {
+        __m128i eq = _mm_cmpeq_epi64(_mm_load_si128((const __m128i*)(tags + i)), key);
+        mask |= (unsigned int)_mm_movemask_pd(_mm_castsi128_pd(eq)) << i;
+    }
+    return mask;
+}
+
+/* tagMatch32Sse4 - Like tagMatch32Avx2(), with SSE4.2 */
+static inline __attribute__((target("sse4.2")))
+unsigned int tagMatch32Sse4(const unsigned int* tags, unsigned int n, unsigned int tag)
+{
+    __m128i key = _mm_set1_epi32((int)tag);
+    unsigned int mask = 0;
+
+    for (unsigned int i = 0; i < n; i += 4) {
+        __m128i eq = _mm_cmpeq_epi32(_mm_load_si128((const __m128i*)(tags + i)), key);
+        mask |= (unsigned int)_mm_movemask_ps(_mm_castsi128_ps(eq)) << i;
+    }
+    return mask;
+}
+
+/* stampOldestSse4 - Like stampOldestAvx2(), with SSE4.2 */
+static inline __attribute__((target("sse4.2")))
+unsigned int stampOldestSse4(const unsigned long long* stamps, unsigned int n)
+{
+    const __m128i* v = (const __m128i*)stamps;
+    __m128i min = _mm_load_si128(v);
+
+    for (unsigned int i = 1; i < n / 2; i++) {
+        __m128i x = _mm_load_si128(v + i);
+        min = _mm_blendv_epi8(min, x, _mm_cmpgt_epi64(min, x));
+    }
+    __m128i x = _mm_shuffle_epi32(min, _MM_SHUFFLE(1, 0, 3, 2));
+    min = _mm_blendv_epi8(min, x, _mm_cmpgt_epi64(min, x));
+
+    unsigned int mask = 0;
+    for (unsigned int i = 0; i < n / 2; i++) {
+        __m128i eq = _mm_cmpeq_epi64(_mm_load_si128(v + i), min);
+        mask |= (unsigned int)_mm_movemask_pd(_mm_castsi128_pd(eq)) << (2 * i);
+    }
+    return __builtin_ctz(mask);
+}
+
+#endif /* __x86_64__ */
+
+#endif /* CACHELAB_TAGSCAN_H */
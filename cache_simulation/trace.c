@@ -0,0 +1,455 @@
+/*
+ * trace.c - Trace readers for the cache simulator
+ *
+ * A reader maps the whole trace file into memory and has the trace's
+ * format (tracefmt.c) decode it in place, instead of going through
+ * fgets() and sscanf() for every line.  The format is detected from the
+ * first bytes of the trace unless one is asked for by name.
+ *
+ * Pipes, FIFOs and stdin ("-") cannot be mapped; those are streamed
+ * through a fixed-size buffer instead.  A line or record split across
+ * two read() calls is moved to the front of the buffer and completed
+ * by the next read, so memory use does not grow with the trace.
+ *
+ * gzip, xz and zstd compressed input, mapped or streamed, is recognized
+ * by its magic bytes and decompressed on a separate thread (decomp.c);
+ * the decompressed bytes are then streamed like a pipe.
+ *
+ * Large mapped text traces are parsed by a pool of threads (pparse.c)
+ * when more than one CPU is available.
+ */
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <stdio.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "decomp.h"
+#include "pparse.h"
+#include "trace.h"
+
+/* Reader state. Decoding always works on [pos, end): for a mapped file
+ * that is the whole file, for a stream it is whatever the last read()s
+ * left in buf. Text is only decoded up to limit, one past the last
+ * complete line; an unterminated last line is copied to tail with a
+ * newline appended, so the scanner never has to check for the end of
+ * the buffer in the middle of a line.
+ */
+struct trace_reader {
+    int fd;             /* streamed input, -1 for a mapped file */
+    char* map;          /* mmap()ed trace file */
+    size_t map_len;
+    char* buf;          /* read buffer for streamed input */
+    size_t buf_size;
+    const char* pos;    /* next byte to decode */
+    const char* end;    /* end of the data available */
+    const char* limit;  /* text: end of the last complete line */
+    char* tail;         /* last line if the input does not end in '\n' */
+    int in_tail;        /* pos/end point into tail */
+    int eof;            /* no more data beyond end */
+    int err;            /* errno of a failed read, or EBADMSG */
+    const trace_format_t* format;
+    mem_addr_t state;   /* decoder state of the format */
+    decomp_t* dec;      /* decoder for compressed input */
+    char* raw;          /* compressed bytes read before dec started */
+    pparse_t* pp;       /* parallel parser for [pos, limit) */
+};
+
+/* Parser threads for large mapped text traces, 0 for one per CPU */
+static int parse_threads = 0;
+
+/* Formats in the order they are detected; lackey, which accepts
+ * anything, comes last
+ */
+#define MAX_FORMATS 16
+static const trace_format_t* formats[MAX_FORMATS] = {
+    &trace_format_csim, &trace_format_din, &trace_format_champsim,
+    &trace_format_lackey,
+};
+static int nformats = 4;
+
+/* Initial read buffer for streamed input; it only grows for lines longer
+ * than this
+ */
+#define STREAM_BUF_SIZE (1 << 20)
+
+/* findLimit - one past the last newline in [pos, end) */
+static const char* findLimit(const char* pos, const char* end)
+{
+    const char* limit = end;
+
+    while (limit > pos && limit[-1] != '\n')
+        limit--;
+    return limit;
+}
+
+/* traceFill - make more input available after the decoder has used up
+ * everything it can. Returns 0 at the end of the trace.
+ */
+static int traceFill(trace_reader_t* reader)
+{
+    if (reader->eof) {
+        size_t len = reader->end - reader->pos;
+
+        if (len == 0 || reader->in_tail)
+            return 0;
+        /* A binary record cut off by the end of the trace */
+        if (!reader->format->text) {
+            reader->err = EBADMSG;
+            return 0;
+        }
+        /* Text that does not end in a newline: decode it from tail */
+        reader->tail = (char*)malloc(len + 1);
+        if (reader->tail == NULL) {
+            reader->err = ENOMEM;
+            return 0;
+        }
+        memcpy(reader->tail, reader->pos, len);
+        reader->tail[len] = '\n';
+        reader->in_tail = 1;
+        reader->pos = reader->tail;
+        reader->end = reader->limit = reader->tail + len + 1;
+        return 1;
+    }
+
+    /* Keep the unfinished line or record and read more behind it */
+    size_t left = reader->end - reader->pos;
+    if (left == reader->buf_size) {
+        char* buf = (char*)realloc(reader->buf, reader->buf_size * 2);
+        if (buf == NULL) {
+            reader->err = ENOMEM;
+            return 0;
+        }
+        reader->buf = buf;
+        reader->buf_size *= 2;
+    } else if (left > 0 && reader->pos != reader->buf) {
+        memmove(reader->buf, reader->pos, left);
+    }
+
+    ssize_t got;
+    do {
+        if (reader->dec != NULL)
+            got = decompRead(reader->dec, reader->buf + left, reader->buf_size - left);
+        else
+            got = read(reader->fd, reader->buf + left, reader->buf_size - left);
+    } while (got < 0 && errno == EINTR);
+    if (got <= 0) {
+        if (got < 0)
+            reader->err = errno;
+        reader->eof = 1;
+        got = 0;
+    }
+
+    reader->pos = reader->buf;
+    reader->end = reader->buf + left + got;
+    if (reader->format == NULL || reader->format->text)
+        reader->limit = findLimit(reader->pos, reader->end);
+    return 1;
+}
+
+/* fillHeader - read enough of a stream to recognize its format */
+static void fillHeader(trace_reader_t* reader)
+{
+    while (!reader->eof && reader->end - reader->pos < TRACE_DETECT_LEN)
+        traceFill(reader);
+}
+
+/* detectFormat - pick the format (unless given) and skip its header.
+ * Returns an errno value.
+ */
+static int detectFormat(trace_reader_t* reader, const trace_format_t* format)
+{
+    const unsigned char* p = (const unsigned char*)reader->pos;
+    size_t len = reader->end - reader->pos;
+    int header = 0;
+
+    if (len > TRACE_DETECT_LEN)
+        len = TRACE_DETECT_LEN;
+    if (format != NULL) {
+        if (format->detect != NULL)
+            header = format->detect(p, len);
+        /* Text formats asked for by name need not look like one */
+        if (header == TRACE_DETECT_NO && format->text)
+            header = 0;
+    } else {
+        for (int i = 0; i < nformats; i++) {
+            if (formats[i]->detect == NULL)
+                continue;
+            header = formats[i]->detect(p, len);
+            if (header != TRACE_DETECT_NO) {
+                format = formats[i];
+                break;
+            }
+        }
+    }
+    if (format == NULL || header < 0)
+        return EINVAL;
+    reader->format = format;
+    reader->pos += header;
+    return 0;
+}
+
+/* startDecoder - feed what has been mapped or read so far, and the rest
+ * of the stream, to a decoder thread, and stream its output instead.
+ * Returns an errno value.
+ */
+static int startDecoder(trace_reader_t* reader, int format)
+{
+    const char* pre = reader->pos;
+    size_t pre_len = reader->end - reader->pos;
+
+    /* The decoder owns the bytes buffered so far */
+    reader->raw = reader->buf;
+    reader->buf_size = STREAM_BUF_SIZE;
+    reader->buf = (char*)malloc(reader->buf_size);
+    if (reader->buf == NULL)
+        return ENOMEM;
+    reader->dec = decompStart(format, reader->fd, pre, pre_len);
+    if (reader->dec == NULL)
+        return errno;
+
+    reader->pos = reader->end = reader->limit = reader->buf;
+    reader->eof = 0;
+    fillHeader(reader);
+    return reader->err;
+}
+
+/* traceOpenFormat - map a regular trace file, or set up a read buffer
+ * for anything else ("-" for stdin, pipes, FIFOs); then look at the
+ * first bytes for a compression header and the trace format
+ */
+trace_reader_t* traceOpenFormat(const char* trace_fn, const trace_format_t* format)
+{
+    struct stat st;
+    trace_reader_t* reader;
+    int is_stdin = strcmp(trace_fn, "-") == 0;
+    int fd = is_stdin ? STDIN_FILENO : open(trace_fn, O_RDONLY);
+
+    if (fd < 0)
+        return NULL;
+    if (fstat(fd, &st) < 0) {
+        if (!is_stdin)
+            close(fd);
+        return NULL;
+    }
+    reader = (trace_reader_t*)calloc(1, sizeof(trace_reader_t));
+    if (reader == NULL) {
+        if (!is_stdin)
+            close(fd);
+        return NULL;
+    }
+    reader->fd = -1;
+
+    if (S_ISREG(st.st_mode)) {
+        reader->map_len = st.st_size;
+        if (reader->map_len > 0) {
+            reader->map = mmap(NULL, reader->map_len, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (reader->map == MAP_FAILED) {
+                int err = errno;
+                if (!is_stdin)
+                    close(fd);
+                free(reader);
+                errno = err;
+                return NULL;
+            }
+            posix_madvise(reader->map, reader->map_len, POSIX_MADV_SEQUENTIAL);
+        }
+        if (!is_stdin)
+            close(fd);
+        reader->pos = reader->map;
+        reader->end = reader->map + reader->map_len;
+        reader->limit = findLimit(reader->pos, reader->end);
+        reader->eof = 1;
+    } else {
+        reader->fd = fd;
+        reader->buf_size = STREAM_BUF_SIZE;
+        reader->buf = (char*)malloc(reader->buf_size);
+        if (reader->buf == NULL) {
+            traceClose(reader);
+            errno = ENOMEM;
+            return NULL;
+        }
+        reader->pos = reader->end = reader->buf;
+        fillHeader(reader);
+    }
+
+    int compression = decompDetect((const unsigned char*)reader->pos,
+                                   reader->end - reader->pos);
+    if (compression != DECOMP_NONE && reader->err == 0)
+        reader->err = startDecoder(reader, compression);
+    if (reader->err == 0)
+        reader->err = detectFormat(reader, format);
+    if (reader->err == 0 && reader->map_len > 0 && reader->dec == NULL &&
+        reader->format->text && reader->limit - reader->pos >= 2 * PPARSE_CHUNK) {
+        int threads = parse_threads;
+        if (threads == 0)
+            threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+        /* Without workers, the text is parsed serially as it is read */
+        if (threads > 1)
+            reader->pp = pparseStart(reader->format->decode, reader->pos, reader->limit,
+                                     threads);
+    }
+    if (reader->err != 0) {
+        int err = reader->err;
+        traceClose(reader);
+        errno = err;
+        return NULL;
+    }
+    return reader;
+}
+
+trace_reader_t* traceOpen(const char* trace_fn)
+{
+    return traceOpenFormat(trace_fn, NULL);
+}
+
+/* traceRead - decode the next batch, refilling the input whenever the
+ * decoder runs out of complete lines or records
+ */
+size_t traceRead(trace_reader_t* reader, trace_rec_t* recs, size_t max)
+{
+    size_t n = 0;
+
+    if (reader->pp != NULL) {
+        n = pparseRead(reader->pp, recs, max);
+        if (n == (size_t)-1) {
+            reader->err = errno;
+            return 0;
+        }
+        if (n == max)
+            return n;
+        /* All chunks done: carry on with the unterminated last line */
+        pparseStop(reader->pp);
+        reader->pp = NULL;
+        reader->pos = reader->limit;
+    }
+
+    const trace_format_t* format = reader->format;
+    while (n < max) {
+        const char* start = reader->pos;
+        const char* end = format->text ? reader->limit : reader->end;
+        size_t got = format->decode(start, end, recs + n, max - n,
+                                    &reader->pos, &reader->state);
+
+        n += got;
+        if (n == max)
+            break;
+        /* A binary decoder that stops with a whole record in front of it
+         * has hit a corrupt one
+         */
+        if (!format->text && got == 0 && reader->pos == start &&
+            (size_t)(end - start) >= format->max_record) {
+            reader->err = EBADMSG;
+            break;
+        }
+        if (!traceFill(reader))
+            break;
+    }
+    return n;
+}
+
+int traceRegisterFormat(const trace_format_t* format)
+{
+    if (nformats == MAX_FORMATS)
+        return -1;
+    memmove(formats + 1, formats, nformats * sizeof(formats[0]));
+    formats[0] = format;
+    nformats++;
+    return 0;
+}
+
+const trace_format_t* traceFindFormat(const char* name)
+{
+    for (int i = 0; i < nformats; i++) {
+        if (strcmp(formats[i]->name, name) == 0)
+            return formats[i];
+    }
+    return NULL;
+}
+
+void traceFormatNames(char* buf, size_t size)
+{
+    size_t len = 0;
+
+    buf[0] = '\0';
+    for (int i = 0; i < nformats && len < size; i++)
+        len += snprintf(buf + len, size - len, "%s%s", i ? ", " : "", formats[i]->name);
+}
+
+/* traceSetThreads - set the number of parser threads */
+void traceSetThreads(int threads)
+{
+    parse_threads = threads;
+}
+
+/* traceError - errno of the error that ended the trace early, 0 if none */
+int traceError(trace_reader_t* reader)
+{
+    return reader->err;
+}
+
+/* traceClose - unmap or close the trace */
+void traceClose(trace_reader_t* reader)
+{
+    if (reader == NULL)
+        return;
+    pparseStop(reader->pp);
+    decompStop(reader->dec);
+    if (reader->map_len > 0)
+        munmap(reader->map, reader->map_len);
+    if (reader->fd > STDIN_FILENO)
+        close(reader->fd);
+    free(reader->buf);
+    free(reader->raw);
+    free(reader->tail);
+    free(reader);
+}
+
+/* traceLoad - read the whole trace, doubling the array as it fills */
+int traceLoad(const char* trace_fn, const trace_format_t* format,
+              trace_rec_t** recs, size_t* n)
+{
+    trace_reader_t* reader = traceOpenFormat(trace_fn, format);
+    size_t cap = 16 * TRACE_BATCH, len = 0, got;
+    trace_rec_t* all;
+    int err;
+
+    if (reader == NULL)
+        return -1;
+    all = (trace_rec_t*)malloc(cap * sizeof(trace_rec_t));
+    while (all != NULL && (got = traceRead(reader, all + len, TRACE_BATCH)) > 0) {
+        len += got;
+        if (cap - len < TRACE_BATCH) {
+            trace_rec_t* grown = (trace_rec_t*)realloc(all, 2 * cap * sizeof(trace_rec_t));
+
+            if (grown == NULL) {
+                free(all);
+                all = NULL;
+                break;
+            }
+            all = grown;
+            cap *= 2;
+        }
+    }
+    err = all == NULL ? ENOMEM : traceError(reader);
+    traceClose(reader);
+    if (err != 0) {
+        free(all);
+        errno = err;
+        return -1;
+    }
+    if (len > 0) {
+        trace_rec_t* fit = (trace_rec_t*)realloc(all, len * sizeof(trace_rec_t));
+
+        if (fit != NULL)
+            all = fit;
+    }
+    *recs = all;
+    *n = len;
+    return 0;
+}
@@ -0,0 +1,174 @@
+/*
+ * trace.h - Trace readers for the cache simulator
+ *
+ * A trace reader decodes a memory trace into batches of trace records.
+ * Instruction fetches are dropped by the reader, so every record it
+ * returns is a data access: L, S or M.
+ *
+ * How the bytes are decoded is up to a trace format (trace_format_t).
+ * Built in are Valgrind lackey text, DineroIV "din" text, ChampSim
+ * instruction records and the compact binary format written by
+ * csim-convert:
+ *
+ *   header:  8-byte magic TRACE_BIN_MAGIC, 32-bit little-endian version,
+ *            32 reserved bits
+ *   record:  1 byte: op (1=L, 2=S, 3=M) in bits 0-1, size in bits 2-7;
+ *            a size field of 63 means the size follows as a varint
+ *            varint: zigzag-encoded difference from the previous address
+ *
+ * Varints are LEB128 (7 bits per byte, least significant group first).
+ * Traces compressed with gzip, xz or zstd are decompressed on the fly,
+ * whatever their format.
+ */
+
+#ifndef CACHELAB_TRACE_H
+#define CACHELAB_TRACE_H
+
+#include <stddef.h>
+
+/* Type: Memory address
+ * Use this type whenever dealing with addresses or address masks
+ */
+typedef unsigned long long int mem_addr_t;
+
+/* Type: Trace record
+ * One decoded data access: op is 'L', 'S' or 'M'. size is 0 for
+ * formats that do not record access sizes.
+ */
+typedef struct trace_rec {
+    mem_addr_t addr;
+    unsigned int size;
+    char op;
+} trace_rec_t;
+
+/* Number of records traceRead() hands out at a time */
+#define TRACE_BATCH 4096
+
+/* Binary trace format */
+#define TRACE_BIN_MAGIC "\x89" "CSIMTR\n"
+#define TRACE_BIN_MAGIC_LEN 8
+#define TRACE_BIN_VERSION 1
+#define TRACE_BIN_HEADER_LEN 16
+#define TRACE_BIN_MAX_REC 21 /* op byte + two 10-byte varints */
+
+/* Bytes of a trace a format's detect() gets to see, if the trace is
+ * that long
+ */
+#define TRACE_DETECT_LEN 64
+
+/* detect() results besides a header length */
+#define TRACE_DETECT_NO  (-1)   /* not in this format */
+#define TRACE_DETECT_BAD (-2)   /* this format, but an unsupported version */
+
+/* Type: Trace format decoder
+ * Decode records from [p, end) into at most max records, store where
+ * decoding stopped in *next and return the number of records. A text
+ * format only ever sees complete lines ([p, end) ends in a newline) and
+ * must not use state, so chunks of a file can be decoded in parallel.
+ * A binary format sees whatever is buffered and must stop in front of
+ * a record that is cut off by end; the reader completes it with the
+ * next read. *state is private to the format and 0 at the start.
+ */
+typedef size_t (*trace_decode_t)(const char* p, const char* end,
+                                 trace_rec_t* recs, size_t max,
+                                 const char** next, mem_addr_t* state);
+
+/* Type: Trace format */
+typedef struct trace_format {
+    const char* name;
+    int text;               /* line based */
+    size_t max_record;      /* binary: bytes in the longest record */
+    /* Look at the first bytes of a trace (len is TRACE_DETECT_LEN unless
+     * the trace is shorter) and return the length of the header to skip,
+     * or TRACE_DETECT_NO/BAD. NULL if the format can only be chosen by
+     * name.
+     */
+    int (*detect)(const unsigned char* p, size_t len);
+    trace_decode_t decode;
+} trace_format_t;
+
+/* Built-in formats */
+extern const trace_format_t trace_format_lackey;
+extern const trace_format_t trace_format_csim;
+extern const trace_format_t trace_format_din;
+extern const trace_format_t trace_format_champsim;
+
+typedef struct trace_reader trace_reader_t;
+
+/*
+ * traceOpen - Open a trace file for reading, detecting its format. "-"
+ *             reads from stdin; pipes and FIFOs are streamed. Returns
+ *             NULL and sets errno if the trace cannot be opened.
+ */
+trace_reader_t* traceOpen(const char* trace_fn);
+
+/*
+ * traceOpenFormat - Like traceOpen(), but decode the trace in the given
+ *                   format (NULL to detect it).
+ */
+trace_reader_t* traceOpenFormat(const char* trace_fn, const trace_format_t* format);
+
+/*
+ * traceRead - Decode up to max records into recs. Returns the number of
+ *             records decoded, 0 at the end of the trace.
+ */
+size_t traceRead(trace_reader_t* reader, trace_rec_t* recs, size_t max);
+
+/*
+ * traceSetThreads - Set the number of threads that parse large mapped
+ *                   text traces in parallel for readers opened from now
+ *                   on. 0 (the default) uses one per online CPU, 1 parses
+ *                   serially.
+ */
+void traceSetThreads(int threads);
+
+/*
+ * traceError - Return the errno of a read error or corrupt input that
+ *              ended the trace early, 0 if the whole trace was read.
+ */
+int traceError(trace_reader_t* reader);
+
+/* traceClose - Release the reader and everything it mapped */
+void traceClose(trace_reader_t* reader);
+
+/*
+ * traceLoad - Decode a whole trace in the given format (NULL to detect
+ *             it) into a new array, stored in *recs with its length in
+ *             *n; the caller frees it. Returns -1 and sets errno if the
+ *             trace cannot be opened or read to the end.
+ */
+int traceLoad(const char* trace_fn, const trace_format_t* format,
+              trace_rec_t** recs, size_t* n);
+
+/*
+ * traceRegisterFormat - Add a format. Registered formats are tried
+ *                       newest first, before the built-in ones. Returns
+ *                       -1 if there is no room for another format.
+ */
+int traceRegisterFormat(const trace_format_t* format);
+
+/* traceFindFormat - Look up a format by name, NULL if there is none */
+const trace_format_t* traceFindFormat(const char* name);
+
+/*
+ * traceFormatNames - Write the names of all formats, separated by ", ",
+ *                    into buf of the given size
+ */
+void traceFormatNames(char* buf, size_t size);
+
+/*
+ * traceEncodeHeader - Write the binary trace header into out, which must
+ *                     hold TRACE_BIN_HEADER_LEN bytes.
+ */
+void traceEncodeHeader(unsigned char* out);
+
+/*
+ * traceEncode - Encode n records in the binary format into out, which
+ *               must hold n * TRACE_BIN_MAX_REC bytes. *prev carries the
+ *               last address across calls and starts at 0. Returns the
+ *               number of bytes written.
+ */
+size_t traceEncode(const trace_rec_t* recs, size_t n,
+                   mem_addr_t* prev, unsigned char* out);
+
+#endif /* CACHELAB_TRACE_H */
@@ -0,0 +1,345 @@
+/*
+ * tracefmt.c - Trace formats
+ *
+ * Decoders for the built-in trace formats, and the encoder for the
+ * binary format.  The text decoders scan lines with a table-driven
+ * hex/decimal scanner; they rely on every line ending in a newline, so
+ * they never check for the end of the buffer in the middle of a line.
+ */
+#include <string.h>
+
+#include "trace.h"
+
+#define X 0xff
+/* Value of each hex digit, X for everything else */
+static const unsigned char hex_value[256] = {
+    X, X, X, X, X, X, X, X, X, X, X, X, X, X, X, X,
+    X, X, X, X, X, X, X, X, X, X, X, X, X, X, X, X,
+    X, X, X, X, X, X, X, X, X, X, X, X, X, X, X, X,
+    0, 1, 2, 3, 4, 5, 6, 7, 8, 9, X, X, X, X, X, X,
+    X,10,11,12,13,14,15, X, X, X, X, X, X, X, X, X,
+    X, X, X, X, X, X, X, X, X, X, X, X, X, X, X, X,
+    X,10,11,12,13,14,15, X, X, X, X, X, X, X, X, X,
+    X, X, X, X, X, X, X, X, X, X, X, X, X, X, X, X,
+    X, X, X, X, X, X, X, X, X, X, X, X, X, X, X, X,
+    X, X, X, X, X, X, X, X, X, X, X, X, X, X, X, X,
+    X, X, X, X, X, X, X, X, X, X, X, X, X, X, X, X,
+    X, X, X, X, X, X, X, X, X, X, X, X, X, X, X, X,
+    X, X, X, X, X, X, X, X, X, X, X, X, X, X, X, X,
+    X, X, X, X, X, X, X, X, X, X, X, X, X, X, X, X,
+    X, X, X, X, X, X, X, X, X, X, X, X, X, X, X, X,
+    X, X, X, X, X, X, X, X, X, X, X, X, X, X, X, X,
+};
+#undef X
+
+/* parseLackey - decode Valgrind lackey lines of the form " L 7ff000398,8".
+ * Only the op character at column 1 is inspected to classify a line,
+ * exactly like the old fgets()/sscanf() loop; every other line
+ * (instruction fetches, Valgrind banners) is skipped.
+ */
+static size_t parseLackey(const char* p, const char* end,
+                          trace_rec_t* recs, size_t max,
+                          const char** next, mem_addr_t* state)
+{
+    size_t n = 0;
+
+    while (n < max && p < end) {
+        char op = p[0] == '\n' ? 0 : p[1];
+
+        if (op == 'L' || op == 'S' || op == 'M') {
+            const unsigned char* q = (const unsigned char*)p + 2;
+            mem_addr_t addr = 0;
+            unsigned int size = 0;
+            unsigned int d;
+
+            while (*q == ' ')
+                q++;
+            while ((d = hex_value[*q]) != 0xff) {
+                addr = (addr << 4) | d;
+                q++;
+            }
+            if (*q == ',') {
+                q++;
+                while ((d = (unsigned int)(*q - '0')) < 10) {
+                    size = size * 10 + d;
+                    q++;
+                }
+            }
+            recs[n].addr = addr;
+            recs[n].size = size;
+            recs[n].op = op;
+            n++;
+            p = (const char*)q;
+        }
+        /* Skip to the start of the next line */
+        p = (const char*)memchr(p, '\n', end - p) + 1;
+    }
+    *next = p;
+    return n;
+}
+
+/* detectLackey - lackey is the fallback for anything not recognized */
+static int detectLackey(const unsigned char* p, size_t len)
+{
+    return 0;
+}
+
+const trace_format_t trace_format_lackey = {
+    "lackey", 1, 0, detectLackey, parseLackey
+};
+
+/* Op character for each binary op code */
+static const char bin_ops[4] = { 0, 'L', 'S', 'M' };
+#define BIN_SIZE_ESCAPE 63
+
+static unsigned char* putVarint(unsigned char* out, mem_addr_t v)
+{
+    while (v >= 0x80) {
+        *out++ = (unsigned char)(v | 0x80);
+        v >>= 7;
+    }
+    *out++ = (unsigned char)v;
+    return out;
+}
+
+/* getVarint - decode a varint from [p, end). Returns NULL if it is
+ * truncated or longer than 64 bits.
+ */
+static const unsigned char* getVarint(const unsigned char* p,
+                                      const unsigned char* end, mem_addr_t* v)
+{
+    mem_addr_t x = 0;
+    int shift = 0;
+
+    while (p < end && shift < 64) {
+        unsigned char c = *p++;
+        x |= (mem_addr_t)(c & 0x7f) << shift;
+        if (!(c & 0x80)) {
+            *v = x;
+            return p;
+        }
+        shift += 7;
+    }
+    return NULL;
+}
+
+void traceEncodeHeader(unsigned char* out)
+{
+    memcpy(out, TRACE_BIN_MAGIC, TRACE_BIN_MAGIC_LEN);
+    out[8] = TRACE_BIN_VERSION & 0xff;
+    out[9] = (TRACE_BIN_VERSION >> 8) & 0xff;
+    out[10] = (TRACE_BIN_VERSION >> 16) & 0xff;
+    out[11] = (TRACE_BIN_VERSION >> 24) & 0xff;
+    memset(out + 12, 0, TRACE_BIN_HEADER_LEN - 12);
+}
+
+size_t traceEncode(const trace_rec_t* recs, size_t n,
+                   mem_addr_t* prev, unsigned char* out)
+{
+    unsigned char* p = out;
+
+    for (size_t i = 0; i < n; i++) {
+        unsigned int code = recs[i].op == 'L' ? 1 : recs[i].op == 'S' ? 2 : 3;
+        mem_addr_t delta = recs[i].addr - *prev;
+
+        if (recs[i].size < BIN_SIZE_ESCAPE) {
+            *p++ = (unsigned char)(code | (recs[i].size << 2));
+        } else {
+            *p++ = (unsigned char)(code | (BIN_SIZE_ESCAPE << 2));
+            p = putVarint(p, recs[i].size);
+        }
+        /* zigzag, so small backward strides stay short */
+        p = putVarint(p, (delta << 1) ^ (mem_addr_t)-(long long)(delta >> 63));
+        *prev = recs[i].addr;
+    }
+    return p - out;
+}
+
+/* parseCsim - decode binary records from [p, end). Decoding stops in
+ * front of a record that is cut off by the end of the data, or that is
+ * corrupt. *state is the previous address.
+ */
+static size_t parseCsim(const char* text, const char* text_end,
+                        trace_rec_t* recs, size_t max,
+                        const char** next, mem_addr_t* state)
+{
+    const unsigned char* p = (const unsigned char*)text;
+    const unsigned char* end = (const unsigned char*)text_end;
+    mem_addr_t prev = *state;
+    size_t n = 0;
+
+    while (n < max && p < end) {
+        unsigned int c = *p;
+        const unsigned char* q = p + 1;
+        mem_addr_t size = c >> 2;
+        mem_addr_t delta;
+
+        if (size == BIN_SIZE_ESCAPE)
+            q = getVarint(q, end, &size);
+        if (q != NULL)
+            q = getVarint(q, end, &delta);
+        if (q == NULL || (c & 3) == 0)
+            break;
+        prev += (delta >> 1) ^ (mem_addr_t)-(long long)(delta & 1);
+        recs[n].addr = prev;
+        recs[n].size = (unsigned int)size;
+        recs[n].op = bin_ops[c & 3];
+        n++;
+        p = q;
+    }
+    *next = (const char*)p;
+    *state = prev;
+    return n;
+}
+
+/* detectCsim - check the magic number and version */
+static int detectCsim(const unsigned char* h, size_t len)
+{
+    if (len < TRACE_BIN_HEADER_LEN ||
+        memcmp(h, TRACE_BIN_MAGIC, TRACE_BIN_MAGIC_LEN) != 0)
+        return TRACE_DETECT_NO;
+    unsigned int version = h[8] | h[9] << 8 | h[10] << 16 | (unsigned int)h[11] << 24;
+    if (version != TRACE_BIN_VERSION)
+        return TRACE_DETECT_BAD;
+    return TRACE_BIN_HEADER_LEN;
+}
+
+const trace_format_t trace_format_csim = {
+    "csim", 0, TRACE_BIN_MAX_REC, detectCsim, parseCsim
+};
+
+/* parseDin - decode DineroIV "din" lines of the form "0 7ff000398 [8]":
+ * label 0 is a data read, 1 a data write; instruction fetches (2) and
+ * the escape labels (3, 4) are skipped. The size is a DineroIV
+ * extension and is 0 when absent.
+ */
+static size_t parseDin(const char* p, const char* end,
+                       trace_rec_t* recs, size_t max,
+                       const char** next, mem_addr_t* state)
+{
+    size_t n = 0;
+
+    while (n < max && p < end) {
+        const unsigned char* q = (const unsigned char*)p;
+        unsigned int label, d;
+
+        while (*q == ' ' || *q == '\t')
+            q++;
+        label = (unsigned int)(*q - '0');
+        if (label <= 1 && (q[1] == ' ' || q[1] == '\t')) {
+            mem_addr_t addr = 0;
+            unsigned int size = 0;
+
+            q += 2;
+            while (*q == ' ' || *q == '\t')
+                q++;
+            if (q[0] == '0' && (q[1] | 0x20) == 'x')
+                q += 2;
+            while ((d = hex_value[*q]) != 0xff) {
+                addr = (addr << 4) | d;
+                q++;
+            }
+            while (*q == ' ' || *q == '\t')
+                q++;
+            while ((d = (unsigned int)(*q - '0')) < 10) {
+                size = size * 10 + d;
+                q++;
+            }
+            recs[n].addr = addr;
+            recs[n].size = size;
+            recs[n].op = label ? 'S' : 'L';
+            n++;
+        }
+        p = (const char*)memchr(q, '\n', end - (const char*)q) + 1;
+    }
+    *next = p;
+    return n;
+}
+
+/* detectDin - the first line starts with a label and an address */
+static int detectDin(const unsigned char* p, size_t len)
+{
+    size_t i = 0;
+
+    while (i < len && (p[i] == ' ' || p[i] == '\t'))
+        i++;
+    if (i + 2 >= len || p[i] < '0' || p[i] > '4' ||
+        (p[i + 1] != ' ' && p[i + 1] != '\t'))
+        return TRACE_DETECT_NO;
+    for (i += 2; i < len && (p[i] == ' ' || p[i] == '\t'); i++)
+        ;
+    return i < len && hex_value[p[i]] != 0xff ? 0 : TRACE_DETECT_NO;
+}
+
+const trace_format_t trace_format_din = {
+    "din", 1, 0, detectDin, parseDin
+};
+
+/* ChampSim traces are a raw array of input_instr structs (64 bytes,
+ * little endian): ip, is_branch, branch_taken, 2 destination and 4
+ * source register bytes, then 2 destination (store) and 4 source (load)
+ * memory addresses, 0 when unused.
+ */
+#define CHAMPSIM_REC 64
+#define CHAMPSIM_DST_MEM 16
+#define CHAMPSIM_SRC_MEM 32
+#define CHAMPSIM_DSTS 2
+#define CHAMPSIM_SRCS 4
+
+static mem_addr_t load64(const unsigned char* p)
+{
+    mem_addr_t v;
+
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+/* parseChampsim - decode the memory accesses of each instruction, loads
+ * before stores as ChampSim issues them. *state counts the accesses of
+ * the instruction at p already returned, so a batch can end in the
+ * middle of an instruction.
+ */
+static size_t parseChampsim(const char* text, const char* text_end,
+                            trace_rec_t* recs, size_t max,
+                            const char** next, mem_addr_t* state)
+{
+    const unsigned char* p = (const unsigned char*)text;
+    const unsigned char* end = (const unsigned char*)text_end;
+    size_t n = 0;
+
+    while (n < max && end - p >= CHAMPSIM_REC) {
+        mem_addr_t addrs[CHAMPSIM_SRCS + CHAMPSIM_DSTS];
+        char ops[CHAMPSIM_SRCS + CHAMPSIM_DSTS];
+        unsigned int count = 0, i;
+
+        for (i = 0; i < CHAMPSIM_SRCS; i++) {
+            addrs[count] = load64(p + CHAMPSIM_SRC_MEM + 8 * i);
+            ops[count] = 'L';
+            count += addrs[count] != 0;
+        }
+        for (i = 0; i < CHAMPSIM_DSTS; i++) {
+            addrs[count] = load64(p + CHAMPSIM_DST_MEM + 8 * i);
+            ops[count] = 'S';
+            count += addrs[count] != 0;
+        }
+        for (i = (unsigned int)*state; i < count && n < max; i++) {
+            recs[n].addr = addrs[i];
+            recs[n].size = 0;
+            recs[n].op = ops[i];
+            n++;
+        }
+        if (i < count) {
+            *state = i;
+            break;
+        }
+        *state = 0;
+        p += CHAMPSIM_REC;
+    }
+    *next = (const char*)p;
+    return n;
+}
+
+/* ChampSim traces have no header, so they are only used when asked for */
+const trace_format_t trace_format_champsim = {
+    "champsim", 0, CHAMPSIM_REC, NULL, parseChampsim
+};